@@ -1,40 +1,205 @@
 #include "cacti.h"
+#include "cacti_node.h"
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// promise - reply slot shared by a future and the message that carries it
+#define PROMISE_PENDING 0
+#define PROMISE_READY 1
+#define PROMISE_BROKEN 2
+
+#define FUTURE_SPIN 1024
+// how long a future_wait outside an inline system sleeps between runs of it
+#define INLINE_SLICE_MS 1
+
+struct actor;
+
+static long long clock_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+typedef struct promise {
+	_Atomic int state;
+	_Atomic int refs;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	message_t reply;
+	// a suspended handler to resume once the promise settles
+	struct actor* waiter;
+} promise_t;
+
+static void actor_resume(struct actor* a);
+
+static promise_t* promise_create() {
+	promise_t* p = (promise_t*)malloc(sizeof(promise_t));
+	if (p == NULL)
+		return NULL;
+
+	if (pthread_mutex_init(&(p->lock), NULL) != 0) {
+		free(p);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&(p->ready), NULL) != 0) {
+		pthread_mutex_destroy(&(p->lock));
+		free(p);
+		return NULL;
+	}
+
+	p->state = PROMISE_PENDING;
+	p->refs = 2;
+	p->waiter = NULL;
+	return p;
+}
+
+static void promise_release(promise_t* p) {
+	if (--(p->refs) == 0) {
+		pthread_cond_destroy(&(p->ready));
+		pthread_mutex_destroy(&(p->lock));
+		free(p);
+	}
+}
+
+// settles the promise and drops the sender side reference
+static void promise_settle(promise_t* p, int state, message_t reply) {
+	if (pthread_mutex_lock(&(p->lock)) != 0)
+		exit(-1);
+
+	p->reply = reply;
+	p->state = state;
+
+	struct actor* waiter = p->waiter;
+	p->waiter = NULL;
+
+	if (pthread_cond_broadcast(&(p->ready)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&(p->lock)) != 0)
+		exit(-1);
+
+	if (waiter != NULL)
+		actor_resume(waiter);
+
+	promise_release(p);
+}
+
+static void promise_break(promise_t* p) {
+	message_t none;
+	none.message_type = MSG_HELLO;
+	none.nbytes = 0;
+	none.data = NULL;
+	promise_settle(p, PROMISE_BROKEN, none);
+}
+
+// buffer - refcounted, immutable once sent; the data follows the header
+struct actor_buffer {
+	_Atomic long refs;
+	size_t nbytes;
+	_Alignas(max_align_t) unsigned char data[];
+};
+
+actor_buffer_t* buffer_create(size_t nbytes) {
+	actor_buffer_t* b = (actor_buffer_t*)malloc(sizeof(actor_buffer_t) + nbytes);
+	if (b == NULL)
+		return NULL;
+
+	b->refs = 1;
+	b->nbytes = nbytes;
+	return b;
+}
+
+void* buffer_data(actor_buffer_t* b) {
+	return b->data;
+}
+
+size_t buffer_size(actor_buffer_t const* b) {
+	return b->nbytes;
+}
+
+actor_buffer_t* buffer_of(void const* data) {
+	return (actor_buffer_t*)((char*)data - offsetof(actor_buffer_t, data));
+}
+
+actor_buffer_t* buffer_retain(actor_buffer_t* b) {
+	++(b->refs);
+	return b;
+}
+
+void buffer_release(actor_buffer_t* b) {
+	if (--(b->refs) == 0)
+		free(b);
+}
+
+struct actor;
+
+// envelope - message together with its delivery metadata
+typedef struct envelope {
+	message_t msg;
+	struct actor* sender;
+	// the global id of a sender on another node, when sender is NULL
+	actor_id_t origin;
+	promise_t* promise;
+	// the delivery's reference to msg.data, dropped once the handler returns
+	actor_buffer_t* buffer;
+	// clock_ns after which the message is shed instead of handled, 0 for never
+	long long deadline;
+} envelope_t;
 
 // q - queue
 typedef struct queue {
 	int cur_len;
 	int max_len;
 	int limit;
-	message_t* messages;
+	envelope_t* messages;
 	int front;
 	int back;
+	// the first ring comes with the header, so a fresh queue is one allocation
+	envelope_t initial[];
 } q_t;
 
+#define Q_INITIAL 2
+
 static q_t* q_init() {
-	q_t* q = (q_t*)malloc(sizeof(q_t));
+	q_t* q = (q_t*)malloc(sizeof(q_t) + sizeof(envelope_t) * Q_INITIAL);
 	if (q == NULL)
 		return NULL;
 	
 	q->cur_len = 0;
-	q->max_len = 2;
+	q->max_len = Q_INITIAL;
 	q->limit = ACTOR_QUEUE_LIMIT;
-
-	q->messages = (message_t*)malloc(sizeof(message_t) * 2);
-	if (q->messages == NULL) {
-		free(q);
-		return NULL;
-	}
-
+	q->messages = q->initial;
 	q->front = 0;
 	q->back = -1;
 	return q;
 }
 
+static _Atomic size_t dropped;
+
 static void q_destroy(q_t** q) {
 	if (q != NULL && *q != NULL) {
-		if ((*q)->messages != NULL)
-			free((*q)->messages);
+		if ((*q)->messages != NULL) {
+			dropped += (*q)->cur_len;
+			for (int i = 0; i < (*q)->cur_len; ++i) {
+				envelope_t* env = &((*q)->messages[((*q)->front + i) % (*q)->max_len]);
+				if (env->promise != NULL)
+					promise_break(env->promise);
+				if (env->buffer != NULL)
+					buffer_release(env->buffer);
+			}
+			if ((*q)->messages != (*q)->initial)
+				free((*q)->messages);
+		}
 		free(*q);
+		*q = NULL;
 	}
 }
 
@@ -50,7 +215,7 @@ static bool q_empty(q_t* q) {
 }
 
 static bool q_full(q_t* q) {
-	return q_size(q) == q->limit;
+	return q != NULL && q_size(q) == q->limit;
 }
 
 #define Q_SUCCESS 0
@@ -58,7 +223,7 @@ static bool q_full(q_t* q) {
 #define Q_EMPTY 2
 #define Q_BAD_ALLOC -1
 
-static int q_push(q_t* q, message_t msg) {
+static int q_push(q_t* q, envelope_t msg) {
 	if (q_full(q))
 		return Q_FULL;
 
@@ -67,7 +232,7 @@ static int q_push(q_t* q, message_t msg) {
 	++(q->cur_len);
 
 	if (q->cur_len >= q->max_len && q->max_len != q->limit) {
-		message_t* new_msgs = (message_t*)malloc(sizeof(message_t) * q->max_len * 2);
+		envelope_t* new_msgs = (envelope_t*)malloc(sizeof(envelope_t) * q->max_len * 2);
 		if (new_msgs == NULL) {
 			--(q->cur_len);
 			q->back = (q->max_len + q->back - 1) % q->max_len;
@@ -78,7 +243,8 @@ static int q_push(q_t* q, message_t msg) {
 			new_msgs[i] = q->messages[(q->front + i) % q->max_len];
 		}
 
-		free(q->messages);
+		if (q->messages != q->initial)
+			free(q->messages);
 		q->messages = new_msgs;
 		q->front = 0;
 		q->back = q->cur_len - 1;
@@ -96,7 +262,8 @@ static int q_pop(q_t* q) {
 	--(q->cur_len);
 
 	if (q->cur_len < q->max_len / 4) {
-		message_t* new_msgs = (message_t*)malloc(sizeof(message_t) * q->max_len / 2);
+		envelope_t* new_msgs = q->max_len / 2 == Q_INITIAL
+			? q->initial : (envelope_t*)malloc(sizeof(envelope_t) * q->max_len / 2);
 		if (new_msgs == NULL) {
 			++(q->cur_len);
 			q->front = (q->max_len + q->front - 1) % q->max_len;
@@ -107,7 +274,8 @@ static int q_pop(q_t* q) {
 			new_msgs[i] = q->messages[(q->front + i) % q->max_len];
 		}
 
-		free(q->messages);
+		if (q->messages != q->initial)
+			free(q->messages);
 		q->messages = new_msgs;
 		q->front = 0;
 		q->back = q->cur_len - 1;
@@ -117,130 +285,331 @@ static int q_pop(q_t* q) {
 	return Q_SUCCESS;
 }
 
-static message_t q_front(q_t* q) {
+static envelope_t q_front(q_t* q) {
 	return q->messages[q->front];
 }
 
 
-// actor
+// actor - a million of them have to fit, so an idle one is a small record out of
+// a slab: no mailbox until mail comes, and a one-byte lock
+
+// guards what senders and the worker share; held for a few stores at a time
+typedef atomic_flag actor_lock_t;
+
+#define ACTOR_LOCK_SPIN 64
+
 typedef struct actor {
 	q_t* msg_q;
+	// messages the actor sent itself; only touched by the worker running it
+	q_t* self_q;
 	role_t const* role;
+	role_ctx_t const* ctx_role;
 	actor_id_t id;
-	bool dead;
-	pthread_mutex_t lock;
 	void* state;
-	bool active;
 
-	int to_wait;
-	int to_signal;
-	pthread_mutex_t lock_thread;
-	pthread_cond_t wait_for_msg[POOL_SIZE];
-	int waiting;
+	// stride scheduling
+	_Atomic long long stride;
+	_Atomic long long pass;
+
+	// set on a group address, which is never scheduled itself
+	struct group* group;
+	// the group address of a balancing member; its mailbox is shared by the members
+	struct actor* pool;
+
+	// handlers run as coroutines; coro is the one running or suspended, awaiting
+	// what it suspended on until its worker lets go of the actor
+	struct coro* coro;
+	promise_t* awaiting;
+
+	// how it sheds load, NULL until actor_shed
+	struct shed* _Atomic shed;
+
+	// turns in the thread queue or held by workers, at most one unless the actor
+	// is reentrant; guarded by lock
+	unsigned short scheduled;
+	actor_lock_t lock;
+	bool dead;
+	// on the pool's idle stack; guarded by the pool's lock
+	bool idle_listed;
+	_Atomic bool suspendable;
+	// workers may run it at once, a message each
+	_Atomic bool reentrant;
 } actor_t;
 
+static void actor_lock(actor_t* a) {
+	for (int spin = 0; atomic_flag_test_and_set_explicit(&(a->lock), memory_order_acquire); ++spin) {
+		// the holder may be off the cpu; let it finish
+		if (spin >= ACTOR_LOCK_SPIN)
+			sched_yield();
+	}
+}
+
+static void actor_unlock(actor_t* a) {
+	atomic_flag_clear_explicit(&(a->lock), memory_order_release);
+}
+
+// replaced ones are kept until the actor is destroyed, as its worker may still read them
+typedef struct shed {
+	size_t depth;
+	void (*expired)(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+	struct shed* replaced;
+} shed_t;
+
+typedef struct group {
+	int routing;
+	size_t members;
+	actor_t** member;
+	uint64_t (*key)(message_t const*);
+	_Atomic size_t next;
+
+	// balancing members waiting for work; guarded by the group address's lock
+	actor_t** idle;
+	size_t nidle;
+} group_t;
+
+#define STRIDE_ONE (1LL << 20)
+
 static size_t count_actors;
 static actor_t* actors[CAST_LIMIT];
 
 static size_t actors_finished;
 static pthread_mutex_t state_counters_lock;
 
+// slab - actors never go away one by one, so they are carved out of big blocks
+// released together with the system
+#define ACTOR_SLAB 4096
 
-static actor_t* actor_init() {
-	actor_t* a = (actor_t*)malloc(sizeof(actor_t));
-	if (a == NULL)
-		return NULL;
-	
-	a->msg_q = q_init();
-	if (a->msg_q == NULL) {
-		free(a);
-		return NULL;
-	}
-	
-	a->dead = false;
-	
-	if (pthread_mutex_init(&(a->lock), NULL) != 0) {
-		q_destroy(&(a->msg_q));
-		free(a);
-		return NULL;
-	}
+typedef struct slab {
+	struct slab* next;
+	size_t used;
+	actor_t actors[ACTOR_SLAB];
+} slab_t;
+
+static slab_t* slabs;
+// records handed out, registered or about to be; never more than CAST_LIMIT
+static _Atomic size_t count_carved;
+
+static actor_t* slab_carve() {
+	actor_t* a = NULL;
 
-	if (pthread_mutex_init(&(a->lock_thread), NULL) != 0) {
-		pthread_mutex_destroy(&(a->lock));
-		q_destroy(&(a->msg_q));
-		free(a);
+	if (pthread_mutex_lock(&state_counters_lock) != 0)
 		return NULL;
-	}
 
-	for (int i = 0; i < POOL_SIZE; ++i) {
-		if (pthread_cond_init(&(a->wait_for_msg[i]), NULL) != 0) {
-			for (int j = 0; j < i; ++j) {
-				pthread_cond_destroy(&(a->wait_for_msg[j]));
+	if (count_carved < CAST_LIMIT) {
+		if (slabs == NULL || slabs->used == ACTOR_SLAB) {
+			slab_t* s = (slab_t*)malloc(sizeof(slab_t));
+
+			if (s != NULL) {
+				s->next = slabs;
+				s->used = 0;
+				slabs = s;
 			}
-			pthread_mutex_destroy(&(a->lock_thread));
-			pthread_mutex_destroy(&(a->lock));
-			q_destroy(&(a->msg_q));
-			free(a);
-			return NULL;
+		}
+
+		if (slabs != NULL && slabs->used < ACTOR_SLAB) {
+			a = &(slabs->actors[slabs->used++]);
+			++count_carved;
 		}
 	}
-	
 
+	if (pthread_mutex_unlock(&state_counters_lock) != 0)
+		return NULL;
+
+	return a;
+}
+
+// after the actors are destroyed
+static void slab_release() {
+	while (slabs != NULL) {
+		slab_t* s = slabs;
+		slabs = s->next;
+		free(s);
+	}
+
+	count_carved = 0;
+}
+
+static actor_t* actor_init() {
+	actor_t* a = slab_carve();
+	if (a == NULL)
+		return NULL;
+
+	// the mailbox comes with the first message
+	a->msg_q = NULL;
+	a->self_q = NULL;
+	a->dead = false;
+	atomic_flag_clear(&(a->lock));
 	a->state = NULL;
-	a->active = false;
-	a->to_wait = 0;
-	a->to_signal = 0;
-	a->waiting = 0;
+	a->scheduled = 0;
+	a->stride = STRIDE_ONE;
+	a->pass = 0;
+	a->group = NULL;
+	a->pool = NULL;
+	a->idle_listed = false;
+	a->suspendable = false;
+	a->reentrant = false;
+	a->shed = NULL;
+	a->coro = NULL;
+	a->awaiting = NULL;
 
 	return a;
 }
 
+static void coro_abandon(struct coro* co);
+
 static void actor_destroy(actor_t** a) {
-	for (int i = 0; i < POOL_SIZE; ++i) {
-		pthread_cond_destroy(&((*a)->wait_for_msg[i]));
+	// a handler still suspended when the system ends never resumes
+	if ((*a)->coro != NULL)
+		coro_abandon((*a)->coro);
+
+	if ((*a)->group != NULL) {
+		free((*a)->group->member);
+		free((*a)->group->idle);
+		free((*a)->group);
 	}
-	pthread_mutex_destroy(&((*a)->lock_thread));
-	pthread_mutex_destroy(&((*a)->lock));
+
+	q_destroy(&((*a)->self_q));
 	q_destroy(&((*a)->msg_q));
-	free(*a);
+	for (shed_t* shed = (*a)->shed; shed != NULL; ) {
+		shed_t* replaced = shed->replaced;
+		free(shed);
+		shed = replaced;
+	}
+
+	*a = NULL;
 }
 
 #define ACTOR_SUCCESS 0
 #define ACTOR_DEAD -1
 #define ACTOR_ERROR -2
 #define ACTOR_IDLE -3
+#define ACTOR_FULL -4
+#define ACTOR_SUSPENDED -5
 
-static int tp_notify(actor_id_t a);
+static int tp_notify(actor_t* a);
+static int tp_run_next(int worker, actor_t* a);
 
-static int actor_send_msg(actor_t* a, message_t msg) {
-	if (pthread_mutex_lock(&(a->lock)) != 0)
-		return ACTOR_ERROR;
+// assumes you have a->lock acquired
+static q_t* actor_mailbox(actor_t* a) {
+	if (a->msg_q == NULL)
+		a->msg_q = q_init();
+
+	return a->msg_q;
+}
+
+static int max_workers;
+
+// takes another turn for the actor if it needs one: the first, and for a reentrant
+// actor one more per waiting message up to a worker each; assumes a->lock acquired
+static bool actor_claim(actor_t* a) {
+	unsigned turns = a->reentrant ? (unsigned)max_workers : 1;
+
+	if (a->scheduled >= turns || (a->scheduled > 0 && a->scheduled >= (unsigned)q_size(a->msg_q)))
+		return false;
+
+	++(a->scheduled);
+	return true;
+}
+
+// messages queued or being handled, plus the creator's hold in quiescent mode
+static _Atomic long in_flight;
+
+// set once shutdown begins - no more sends or spawns are accepted
+static _Atomic bool closing;
+
+static int group_send(actor_t* g, envelope_t env, int worker);
 
-	if (a->dead)
+// worker is the slot of the calling worker thread, -1 outside the pool
+static int actor_send_env(actor_t* a, envelope_t env, int worker) {
+	if (a->group != NULL)
+		return group_send(a, env, worker);
+
+	actor_lock(a);
+
+	if (a->dead || closing) {
+		actor_unlock(a);
 		return ACTOR_DEAD;
+	}
 
-	int ret = q_push(a->msg_q, msg);
+	++in_flight;
+	int ret = actor_mailbox(a) == NULL ? Q_BAD_ALLOC : q_push(a->msg_q, env);
 
 	if (ret != Q_SUCCESS) {
-		return ACTOR_ERROR;
+		--in_flight;
+		actor_unlock(a);
+		return ret == Q_FULL ? ACTOR_FULL : ACTOR_ERROR;
 	}
 
-	if (pthread_mutex_unlock(&(a->lock)) != 0)
+	bool wake = actor_claim(a);
+
+	actor_unlock(a);
+
+	if (wake && (worker < 0 ? tp_notify(a) : tp_run_next(worker, a)) != 0)
+		return ACTOR_ERROR;
+
+	return ACTOR_SUCCESS;
+}
+
+// the actor sends to itself from its own handler - the worker already owns it,
+// so there is nobody to wake. self_q is handled before the mailbox, so it only
+// takes the message while the mailbox is empty; everything on it is older than
+// what the mailbox holds
+static int actor_send_self(actor_t* a, envelope_t env, int worker) {
+	// other workers may be running it too, so it has no queue of its own
+	if (a->reentrant)
+		return actor_send_env(a, env, worker);
+
+	if (a->dead || closing)
+		return ACTOR_DEAD;
+
+	// only this worker takes from the mailbox, so once seen queued it stays that way
+	actor_lock(a);
+	bool queued = !q_empty(a->msg_q);
+	actor_unlock(a);
+
+	// a full self_q spills into the mailbox, which is behind it anyway
+	if (queued || q_full(a->self_q))
+		return actor_send_env(a, env, worker);
+
+	if (a->self_q == NULL && (a->self_q = q_init()) == NULL)
 		return ACTOR_ERROR;
 
-	if (tp_notify(a->id) != 0)
+	++in_flight;
+
+	if (q_push(a->self_q, env) != Q_SUCCESS) {
+		--in_flight;
 		return ACTOR_ERROR;
+	}
 
 	return ACTOR_SUCCESS;
 }
 
+static int actor_send_until(actor_t* a, message_t msg, actor_t* sender, int worker, long long deadline) {
+	envelope_t env;
+	env.msg = msg;
+	env.sender = sender;
+	env.origin = ACTOR_ID_NONE;
+	env.promise = NULL;
+	env.buffer = NULL;
+	env.deadline = deadline;
+
+	if (a == sender && worker >= 0)
+		return actor_send_self(a, env, worker);
+
+	return actor_send_env(a, env, worker);
+}
+
+static int actor_send_msg(actor_t* a, message_t msg, actor_t* sender, int worker) {
+	return actor_send_until(a, msg, sender, worker, 0);
+}
+
 // assumes you have a->lock acquired
-static message_t actor_take_msg(actor_t* a) {
+static envelope_t actor_take_msg(actor_t* a) {
 	if (q_empty(a->msg_q)) {
 		exit(-1);
 	}
 
-	message_t ret = q_front(a->msg_q);
+	envelope_t ret = q_front(a->msg_q);
 
 	if (q_pop(a->msg_q) != Q_SUCCESS)
 		exit(-1);
@@ -263,15 +632,11 @@ static actor_t* actor_get(actor_id_t actor_id) {
 	return a;
 }
 
-static actor_t* actor_create(role_t* const role) {
-	actor_t* a = actor_init();
-	if (a == NULL)
-		return NULL;
-
+// makes a fully set up actor reachable by its id
+static actor_t* actor_register(actor_t* a) {
 	if (pthread_mutex_lock(&state_counters_lock) != 0)
 		return NULL;
 
-	a->role = role;
 	a->id = count_actors;
 	actors[count_actors] = a;
 	++count_actors;
@@ -282,6 +647,24 @@ static actor_t* actor_create(role_t* const role) {
 	return a;
 }
 
+static void actor_weigh(actor_t* a, unsigned weight) {
+	if (weight > ACTOR_WEIGHT_MAX)
+		weight = ACTOR_WEIGHT_MAX;
+
+	a->stride = STRIDE_ONE / (weight > 0 ? weight : ACTOR_WEIGHT_DEFAULT);
+}
+
+static actor_t* actor_create(role_t* const role, role_ctx_t* const ctx_role) {
+	actor_t* a = actor_init();
+	if (a == NULL)
+		return NULL;
+
+	a->role = role;
+	a->ctx_role = ctx_role;
+
+	return actor_register(a);
+}
+
 static message_t msg_hello(actor_t* a) {
 	message_t new_msg;
 	new_msg.message_type = MSG_HELLO;
@@ -298,673 +681,3037 @@ static message_t msg_hello(actor_t* a) {
 	return new_msg;
 }
 
-static int actor_handle_spawn(actor_t* a, message_t msg) {
-	actor_t* new_a = actor_create((role_t*)msg.data);
-	if (new_a == NULL)
-		return ACTOR_ERROR;
+// group - one address in front of members of the same role
+
+// wakes a member nobody has scheduled yet
+static int actor_wake(actor_t* a, int worker) {
+	actor_lock(a);
+
+	bool wake = actor_claim(a);
+
+	actor_unlock(a);
 
-	actor_send_msg(new_a, msg_hello(a));
+	if (wake && (worker < 0 ? tp_notify(a) : tp_run_next(worker, a)) != 0)
+		return ACTOR_ERROR;
 
 	return ACTOR_SUCCESS;
 }
 
-static int actor_handle_godie(actor_t* a) {
-	if (pthread_mutex_lock(&(a->lock)) != 0)
-		return ACTOR_ERROR;
-	
-	if (!(a->dead)) {
-		a->dead = true;
-		
-		if (pthread_mutex_lock(&state_counters_lock) != 0)
-			return ACTOR_ERROR;
+// a balancing member with an empty mailbox takes the next shared message, or
+// its godie once the group is dead and the shared queue drained; called with
+// the member's lock held
+static bool group_take(actor_t* g, envelope_t* env) {
+	actor_lock(g);
 
-		++actors_finished;
+	bool taken = !q_empty(g->msg_q);
+	q_t* drained = NULL;
 
-		if (pthread_mutex_unlock(&state_counters_lock) != 0)
-			return ACTOR_ERROR;
+	if (taken) {
+		*env = actor_take_msg(g);
+	}
+	else if (g->dead) {
+		env->msg.message_type = MSG_GODIE;
+		env->msg.nbytes = 0;
+		env->msg.data = NULL;
+		env->sender = NULL;
+		env->origin = ACTOR_ID_NONE;
+		env->promise = NULL;
+		env->buffer = NULL;
+		env->deadline = 0;
+
+		++in_flight;
+		taken = true;
 	}
 
-	if (pthread_mutex_unlock(&(a->lock)) != 0)
-		return ACTOR_ERROR;
+	if (q_empty(g->msg_q)) {
+		drained = g->msg_q;
+		g->msg_q = NULL;
+	}
 
-	return ACTOR_SUCCESS;
+	actor_unlock(g);
+
+	q_destroy(&drained);
+
+	return taken;
 }
 
-static int actor_handle_message(actor_t* a, message_t msg) {
-	message_type_t command = msg.message_type;
+// a balancing member is about to go idle; returns true if shared work or the group's
+// godie came in meanwhile, otherwise it waits on the idle stack - called with the
+// member's lock held
+static bool group_idle(actor_t* g, actor_t* member) {
+	actor_lock(g);
 
-	if ((size_t)command >= a->role->nprompts)
-		return ACTOR_ERROR;
+	bool pending = !q_empty(g->msg_q) || g->dead;
 
-	(a->role->prompts)[command](&(a->state), msg.nbytes, msg.data);
-	return ACTOR_SUCCESS;
+	if (!pending && !(member->idle_listed)) {
+		g->group->idle[g->group->nidle++] = member;
+		member->idle_listed = true;
+	}
+
+	actor_unlock(g);
+
+	return pending;
 }
 
-static pthread_key_t thread_number;
+// a dead member takes no more shared work
+static void group_forget(actor_t* g, actor_t* member) {
+	actor_lock(g);
 
-static int actor_exec(actor_t* a) {
-	if (pthread_mutex_lock(&(a->lock)) != 0)
-		return ACTOR_ERROR;
+	group_t* grp = g->group;
 
-	if (q_empty(a->msg_q)) {
-		if (pthread_mutex_unlock(&(a->lock)) != 0)
-			return ACTOR_ERROR;
-		return ACTOR_IDLE;
+	for (size_t i = 0; member->idle_listed && i < grp->nidle; ++i) {
+		if (grp->idle[i] == member) {
+			grp->idle[i] = grp->idle[--grp->nidle];
+			member->idle_listed = false;
+		}
+	}
+
+	actor_unlock(g);
+}
+
+// jump consistent hash: a key keeps its member when members are added
+static size_t group_jump_hash(uint64_t key, size_t buckets) {
+	int64_t b = -1;
+	int64_t j = 0;
+
+	while (j < (int64_t)buckets) {
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (int64_t)((double)(b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
 	}
 
-	message_t msg = actor_take_msg(a);
+	return (size_t)b;
+}
 
-	if (pthread_mutex_unlock(&(a->lock)) != 0)
-		return ACTOR_ERROR;
+static _Thread_local uint64_t route_seed;
 
-	switch (msg.message_type) {
-		case MSG_SPAWN:
-			return actor_handle_spawn(a, msg);
+static size_t group_route(group_t* grp, message_t const* msg) {
+	switch (grp->routing) {
+		case ACTOR_GROUP_ROUND_ROBIN:
+			return grp->next++ % grp->members;
 
-		case MSG_GODIE:
-			return actor_handle_godie(a);
+		case ACTOR_GROUP_RANDOM:
+			if (route_seed == 0)
+				route_seed = (uint64_t)(uintptr_t)&route_seed ^ (uint64_t)time(NULL) ^ 0x9e3779b97f4a7c15ULL;
+
+			// xorshift64
+			route_seed ^= route_seed << 13;
+			route_seed ^= route_seed >> 7;
+			route_seed ^= route_seed << 17;
+			return route_seed % grp->members;
 
 		default:
-			return actor_handle_message(a, msg);
+			return group_jump_hash(grp->key(msg), grp->members);
 	}
 }
 
+// every member gets a godie behind what was already sent to it, then the address dies
+static int group_godie(actor_t* g, envelope_t env, int worker) {
+	group_t* grp = g->group;
+	actor_t** wake = NULL;
+	size_t nwake = 0;
 
-// tq - thread queue
-typedef struct tq {
-	int cur_len;
-	int max_len;
-	actor_id_t* actors;
-	int front;
-	int back;
-} tq_t;
+	if (env.promise != NULL)
+		promise_break(env.promise);
 
-static tq_t* tq_init() {
-	tq_t* q = (tq_t*)malloc(sizeof(tq_t));
-	if (q == NULL)
-		return NULL;
-	
-	q->cur_len = 0;
-	q->max_len = 2;
+	if (env.buffer != NULL)
+		buffer_release(env.buffer);
 
-	q->actors = (actor_id_t*)malloc(sizeof(actor_id_t) * 2);
-	if (q->actors == NULL) {
-		free(q);
-		return NULL;
-	}
+	env.promise = NULL;
+	env.buffer = NULL;
 
-	q->front = 0;
-	q->back = -1;
-	return q;
-}
+	actor_lock(g);
 
-static void tq_destroy(tq_t** q) {
-	if (*q != NULL) {
-		if ((*q)->actors != NULL)
-			free((*q)->actors);
-		free(*q);
+	if (g->dead || closing) {
+		actor_unlock(g);
+		return ACTOR_DEAD;
 	}
-}
 
-static int tq_size(tq_t* q) {
-	if (q == NULL || q->actors == NULL)
-		return 0;
-	else
-		return q->cur_len;
-}
+	// balancing members each make their own godie once the shared queue is drained,
+	// so a full one takes nothing more; the idle ones are woken to do it
+	if (grp->routing == ACTOR_GROUP_BALANCE) {
+		wake = grp->idle;
+		nwake = grp->nidle;
 
-static bool tq_empty(tq_t* q) {
-	return tq_size(q) <= 0;
-}
+		for (size_t i = 0; i < nwake; ++i)
+			wake[i]->idle_listed = false;
 
-#define TQ_SUCCESS 0
-#define TQ_EMPTY 1
-#define TQ_BAD_ALLOC -1
+		grp->nidle = 0;
+	}
 
-static int tq_push(tq_t* q, actor_id_t a) {
-	q->back = (q->back + 1) % q->max_len;
-	q->actors[q->back] = a;
-	++(q->cur_len);
+	g->dead = true;
 
-	if (q->cur_len >= q->max_len) {
-		actor_id_t* new_actors = (actor_id_t*)malloc(sizeof(actor_id_t) * q->max_len * 2);
-		if (new_actors == NULL) {
-			--(q->cur_len);
-			q->back = (q->max_len + q->back - 1) % q->max_len;
-			return TQ_BAD_ALLOC;
-		}
+	actor_unlock(g);
 
-		for (int i = 0; i < q->cur_len; ++i) {
-			new_actors[i] = q->actors[(q->front + i) % q->max_len];
+	for (size_t i = 0; i < nwake; ++i) {
+		if (actor_wake(wake[i], worker) != ACTOR_SUCCESS)
+			return ACTOR_ERROR;
+	}
+
+	if (grp->routing != ACTOR_GROUP_BALANCE) {
+		for (size_t i = 0; i < grp->members; ++i) {
+			int ret = actor_send_env(grp->member[i], env, worker);
+			if (ret == ACTOR_ERROR || ret == ACTOR_FULL)
+				return ACTOR_ERROR;
+		}
+	}
+
+	if (pthread_mutex_lock(&state_counters_lock) != 0)
+		return ACTOR_ERROR;
+
+	++actors_finished;
+
+	if (pthread_mutex_unlock(&state_counters_lock) != 0)
+		return ACTOR_ERROR;
+
+	return ACTOR_SUCCESS;
+}
+
+static int group_send(actor_t* g, envelope_t env, int worker) {
+	group_t* grp = g->group;
+
+	if (env.msg.message_type == MSG_GODIE)
+		return group_godie(g, env, worker);
+
+	if (grp->routing != ACTOR_GROUP_BALANCE)
+		return actor_send_env(grp->member[group_route(grp, &(env.msg))], env, worker);
+
+	actor_lock(g);
+
+	if (g->dead || closing) {
+		actor_unlock(g);
+		return ACTOR_DEAD;
+	}
+
+	++in_flight;
+
+	if (actor_mailbox(g) == NULL || q_push(g->msg_q, env) != Q_SUCCESS) {
+		--in_flight;
+		actor_unlock(g);
+		return ACTOR_ERROR;
+	}
+
+	actor_t* member = grp->nidle > 0 ? grp->idle[--grp->nidle] : NULL;
+
+	if (member != NULL)
+		member->idle_listed = false;
+
+	actor_unlock(g);
+
+	// busy members look at the shared queue before they go idle, so nobody else needs waking
+	if (member != NULL)
+		return actor_wake(member, worker);
+
+	return ACTOR_SUCCESS;
+}
+
+// an ask for a spawn is handed to the new actor, which answers it from its hello
+static int actor_handle_spawn(actor_t* a, envelope_t env, int t_num) {
+	message_t msg = env.msg;
+	actor_t* new_a;
+
+	if (closing) {
+		if (env.promise != NULL)
+			promise_break(env.promise);
+		return ACTOR_SUCCESS;
+	}
+
+	if (msg.message_type == MSG_SPAWN_CTX)
+		new_a = actor_create(NULL, (role_ctx_t*)msg.data);
+	else
+		new_a = actor_create((role_t*)msg.data, NULL);
+
+	// with CAST_LIMIT actors there is no room left; the spawn is refused, not the spawner
+	if (new_a == NULL) {
+		if (env.promise != NULL)
+			promise_break(env.promise);
+		return count_carved < CAST_LIMIT ? ACTOR_ERROR : ACTOR_SUCCESS;
+	}
+
+	envelope_t hello;
+	hello.msg = msg_hello(a);
+	hello.sender = a;
+	hello.origin = ACTOR_ID_NONE;
+	hello.promise = env.promise;
+	hello.buffer = NULL;
+	hello.deadline = 0;
+
+	if (actor_send_env(new_a, hello, t_num) != ACTOR_SUCCESS && env.promise != NULL)
+		promise_break(env.promise);
+
+	return ACTOR_SUCCESS;
+}
+
+static int actor_handle_godie(actor_t* a) {
+	actor_lock(a);
+
+	bool dying = !(a->dead);
+	a->dead = true;
+
+	actor_unlock(a);
+
+	// only its own worker handles the godie, so the rest needs no spin lock,
+	// which must not be held across a mutex that may sleep
+	if (!dying)
+		return ACTOR_SUCCESS;
+
+	if (a->pool != NULL)
+		group_forget(a->pool, a);
+
+	if (pthread_mutex_lock(&state_counters_lock) != 0)
+		return ACTOR_ERROR;
+
+	++actors_finished;
+
+	if (pthread_mutex_unlock(&state_counters_lock) != 0)
+		return ACTOR_ERROR;
+
+	return ACTOR_SUCCESS;
+}
+
+// coro - a handler on its own stack, so it can suspend and let the worker go
+#ifndef CORO_STACK_SIZE
+#define CORO_STACK_SIZE (64 << 10)
+#endif
+
+typedef struct coro {
+	ucontext_t ctx;
+	// where the worker running the handler continues when it suspends or ends
+	ucontext_t* back;
+	actor_ctx_t actx;
+	actor_t* actor;
+	envelope_t env;
+	promise_t* awaited;
+	bool done;
+	struct coro* next;
+	_Alignas(16) unsigned char stack[CORO_STACK_SIZE];
+} coro_t;
+
+// finished coroutines keep their stacks for the next handler
+static coro_t* coro_free = NULL;
+static pthread_mutex_t coro_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static coro_t* coro_get() {
+	if (pthread_mutex_lock(&coro_lock) != 0)
+		exit(-1);
+
+	coro_t* co = coro_free;
+	if (co != NULL)
+		coro_free = co->next;
+
+	if (pthread_mutex_unlock(&coro_lock) != 0)
+		exit(-1);
+
+	if (co == NULL)
+		co = (coro_t*)malloc(sizeof(coro_t));
+
+	return co;
+}
+
+static void coro_put(coro_t* co) {
+	if (pthread_mutex_lock(&coro_lock) != 0)
+		exit(-1);
+
+	co->next = coro_free;
+	coro_free = co;
+
+	if (pthread_mutex_unlock(&coro_lock) != 0)
+		exit(-1);
+}
+
+static void coro_abandon(coro_t* co) {
+	if (co->env.buffer != NULL)
+		buffer_release(co->env.buffer);
+
+	if (co->awaited != NULL)
+		promise_release(co->awaited);
+
+	coro_put(co);
+}
+
+// makecontext only passes ints, so the coroutine comes in two halves
+static void coro_main(unsigned int hi, unsigned int lo) {
+	coro_t* co = (coro_t*)(((uintptr_t)hi << 32) | (uintptr_t)lo);
+	actor_t* a = co->actor;
+	message_t msg = co->env.msg;
+
+	(a->ctx_role->prompts)[msg.message_type](&(co->actx), &(a->state), msg.nbytes, msg.data);
+
+	// an ask that was neither answered nor forwarded will never be
+	if (co->actx.reply_handle != NULL)
+		promise_break((promise_t*)co->actx.reply_handle);
+
+	co->done = true;
+	swapcontext(&(co->ctx), co->back);
+}
+
+// runs the handler until it ends or suspends
+static int coro_run(actor_t* a, coro_t* co, int t_num) {
+	ucontext_t back;
+	co->back = &back;
+	co->actx.worker = t_num;
+
+	if (swapcontext(&back, &(co->ctx)) != 0)
+		exit(-1);
+
+	if (!co->done) {
+		a->awaiting = co->awaited;
+		return ACTOR_SUSPENDED;
+	}
+
+	a->coro = NULL;
+	coro_put(co);
+	return ACTOR_SUCCESS;
+}
+
+// getcontext returns twice as far as the compiler knows, so it gets a frame of
+// its own; inlined, every local of the caller would have to survive a longjmp
+static __attribute__((noinline)) int coro_prepare(coro_t* co) {
+	if (getcontext(&(co->ctx)) != 0)
+		return -1;
+
+	co->ctx.uc_stack.ss_sp = co->stack;
+	co->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+	co->ctx.uc_link = NULL;
+
+	uintptr_t bits = (uintptr_t)co;
+	makecontext(&(co->ctx), (void (*)(void))coro_main, 2, (unsigned int)(bits >> 32), (unsigned int)bits);
+	return 0;
+}
+
+static int coro_start(actor_t* a, envelope_t env, int t_num) {
+	coro_t* co = coro_get();
+	if (co == NULL)
+		return ACTOR_ERROR;
+
+	co->actor = a;
+	co->env = env;
+	co->awaited = NULL;
+	co->done = false;
+
+	co->actx.self = a->id;
+	co->actx.sender = env.sender == NULL ? env.origin : env.sender->id;
+	co->actx.self_handle = a;
+	co->actx.sender_handle = env.sender;
+	co->actx.reply_handle = env.promise;
+
+	if (coro_prepare(co) != 0) {
+		coro_put(co);
+		return ACTOR_ERROR;
+	}
+
+	a->coro = co;
+	return coro_run(a, co, t_num);
+}
+
+// called on the coroutine's stack; returns once p settled and a worker took the actor again
+static void coro_suspend(coro_t* co, promise_t* p) {
+	co->awaited = p;
+
+	if (swapcontext(&(co->ctx), co->back) != 0)
+		exit(-1);
+
+	co->awaited = NULL;
+}
+
+static void actor_ctx_init(actor_ctx_t* ctx, actor_t* a, envelope_t const* env, int t_num) {
+	ctx->self = a->id;
+	ctx->sender = env->sender == NULL ? env->origin : env->sender->id;
+	ctx->worker = t_num;
+	ctx->self_handle = a;
+	ctx->sender_handle = env->sender;
+	ctx->reply_handle = env->promise;
+}
+
+static int actor_handle_message(actor_t* a, envelope_t env, int t_num) {
+	message_t msg = env.msg;
+	message_type_t command = msg.message_type;
+
+	if (a->ctx_role != NULL) {
+		if ((size_t)command >= a->ctx_role->nprompts)
+			return ACTOR_ERROR;
+
+		if (a->suspendable)
+			return coro_start(a, env, t_num);
+
+		actor_ctx_t ctx;
+		actor_ctx_init(&ctx, a, &env, t_num);
+
+		(a->ctx_role->prompts)[command](&ctx, &(a->state), msg.nbytes, msg.data);
+
+		// an ask that was neither answered nor forwarded will never be
+		if (ctx.reply_handle != NULL)
+			promise_break((promise_t*)ctx.reply_handle);
+
+		return ACTOR_SUCCESS;
+	}
+
+	if ((size_t)command >= a->role->nprompts)
+		return ACTOR_ERROR;
+
+	(a->role->prompts)[command](&(a->state), msg.nbytes, msg.data);
+
+	if (env.promise != NULL)
+		promise_break(env.promise);
+
+	return ACTOR_SUCCESS;
+}
+
+// messages dropped for their deadline or the depth of their mailbox
+static _Atomic size_t shed_count;
+
+// whether the actor drops the message instead of handling it, with waiting more
+// behind it in the mailbox; the system's own messages are always handled
+static bool actor_stale(actor_t* a, envelope_t const* env, int waiting) {
+	switch (env->msg.message_type) {
+		case MSG_SPAWN:
+		case MSG_SPAWN_CTX:
+		case MSG_GODIE:
+		case MSG_HELLO:
+			return false;
+
+		default:
+			break;
+	}
+
+	if (env->deadline != 0 && clock_ns() > env->deadline)
+		return true;
+
+	shed_t* shed = a->shed;
+	return shed != NULL && shed->depth > 0 && (size_t)waiting >= shed->depth;
+}
+
+// the expiry callback gets the message in place of the handler; an ask it leaves
+// unanswered is broken like any other
+static int actor_handle_stale(actor_t* a, envelope_t env, int t_num) {
+	++shed_count;
+
+	actor_ctx_t ctx;
+	actor_ctx_init(&ctx, a, &env, t_num);
+
+	shed_t* shed = a->shed;
+
+	if (shed != NULL && shed->expired != NULL)
+		shed->expired(&ctx, &(a->state), env.msg.nbytes, env.msg.data);
+
+	if (ctx.reply_handle != NULL)
+		promise_break((promise_t*)ctx.reply_handle);
+
+	if (env.buffer != NULL)
+		buffer_release(env.buffer);
+
+	return ACTOR_SUCCESS;
+}
+
+// batch - a run of messages handled in one call of a role's batch prompt
+typedef struct batch {
+	role_ctx_t const* role;
+	message_type_t type;
+	void (*prompt)(actor_ctx_t* ctx, void** stateptr, size_t count, message_t const* messages,
+		actor_id_t const* senders);
+	size_t max;
+} batch_t;
+
+// only added to while no system runs
+static batch_t batches[ACTOR_BATCH_PROMPTS];
+static size_t nbatches = 0;
+
+static batch_t const* batch_find(actor_t* a, message_type_t type) {
+	for (size_t i = 0; i < nbatches; ++i) {
+		if (batches[i].role == a->ctx_role && batches[i].type == type)
+			return &(batches[i]);
+	}
+
+	return NULL;
+}
+
+// takes what can join the batch that starts with run[0] off the front of q;
+// returns the length of the run
+static size_t batch_take(q_t* q, batch_t const* b, envelope_t* run) {
+	size_t n = 1;
+
+	while (n < b->max && !q_empty(q)) {
+		envelope_t* next = &(q->messages[q->front]);
+
+		// an ask needs its own reply, and a deadline has to be checked on its own
+		if (next->msg.message_type != run[0].msg.message_type || next->promise != NULL || next->deadline != 0)
+			break;
+
+		run[n++] = *next;
+
+		if (q_pop(q) != Q_SUCCESS)
+			exit(-1);
+	}
+
+	return n;
+}
+
+static int actor_handle_batch(actor_t* a, batch_t const* b, envelope_t* run, size_t n, int t_num) {
+	message_t msgs[ACTOR_BATCH_MAX];
+	actor_id_t senders[ACTOR_BATCH_MAX];
+
+	for (size_t i = 0; i < n; ++i) {
+		msgs[i] = run[i].msg;
+		senders[i] = run[i].sender == NULL ? run[i].origin : run[i].sender->id;
+	}
+
+	actor_ctx_t ctx;
+	actor_ctx_init(&ctx, a, &(run[0]), t_num);
+
+	b->prompt(&ctx, &(a->state), n, msgs, senders);
+
+	if (ctx.reply_handle != NULL)
+		promise_break((promise_t*)ctx.reply_handle);
+
+	for (size_t i = 0; i < n; ++i) {
+		if (run[i].buffer != NULL)
+			buffer_release(run[i].buffer);
+	}
+
+	return ACTOR_SUCCESS;
+}
+
+static pthread_key_t thread_number;
+
+static int actor_dispatch(actor_t* a, envelope_t env, int t_num) {
+	int ret;
+
+	if (env.promise != NULL && env.msg.message_type == MSG_GODIE)
+		promise_break(env.promise);
+
+	switch (env.msg.message_type) {
+		case MSG_SPAWN:
+		case MSG_SPAWN_CTX:
+			ret = actor_handle_spawn(a, env, t_num);
+			break;
+
+		case MSG_GODIE:
+			ret = actor_handle_godie(a);
+			break;
+
+		default:
+			ret = actor_handle_message(a, env, t_num);
+			break;
+	}
+
+	// a suspended handler still reads the data
+	if (env.buffer != NULL && ret != ACTOR_SUSPENDED)
+		buffer_release(env.buffer);
+
+	return ret;
+}
+
+// one message, or a batch of them when its type has a batch prompt; run[0] is
+// already taken off q, which the caller holds; returns how many were taken
+static size_t actor_take_run(actor_t* a, q_t* q, envelope_t* run, batch_t const** b, bool* stale) {
+	*b = NULL;
+	*stale = actor_stale(a, &(run[0]), q_size(q));
+
+	if (*stale || nbatches == 0 || (*b = batch_find(a, run[0].msg.message_type)) == NULL)
+		return 1;
+
+	return batch_take(q, *b, run);
+}
+
+static int actor_handle_run(actor_t* a, envelope_t* run, size_t n, batch_t const* b, bool stale, int t_num) {
+	if (stale)
+		return actor_handle_stale(a, run[0], t_num);
+
+	if (b != NULL)
+		return actor_handle_batch(a, b, run, n, t_num);
+
+	return actor_dispatch(a, run[0], t_num);
+}
+
+#define SELF_DRAIN_LIMIT 64
+
+// one turn of the actor on a worker: a message from the mailbox, then the ones
+// it sent itself meanwhile; a reentrant turn only takes the one message, as other
+// workers may be taking the others. returns how many were handled
+static int actor_exec(actor_t* a, int t_num, bool reentrant) {
+	int handled = 0;
+	int ret;
+
+	envelope_t run[ACTOR_BATCH_MAX];
+	batch_t const* b;
+	bool stale;
+	size_t n;
+
+	// the actor was only scheduled again because what its handler awaits settled
+	if (a->coro != NULL) {
+		actor_buffer_t* buffer = a->coro->env.buffer;
+
+		if ((ret = coro_run(a, a->coro, t_num)) == ACTOR_SUSPENDED)
+			return handled;
+
+		if (buffer != NULL)
+			buffer_release(buffer);
+
+		++handled;
+	}
+	else if (reentrant || q_empty(a->self_q)) {
+		actor_lock(a);
+
+		if (!q_empty(a->msg_q)) {
+			run[0] = actor_take_msg(a);
+			n = actor_take_run(a, a->msg_q, run, &b, &stale);
+		}
+		else if (a->pool != NULL && !a->dead && group_take(a->pool, &(run[0]))) {
+			b = NULL;
+			n = 1;
+			stale = actor_stale(a, &(run[0]), 0);
+		}
+		else {
+			actor_unlock(a);
+			return ACTOR_IDLE;
+		}
+
+		actor_unlock(a);
+
+		if ((ret = actor_handle_run(a, run, n, b, stale, t_num)) == ACTOR_ERROR)
+			return ACTOR_ERROR;
+
+		// the message counts as handled once its handler ends
+		if (ret == ACTOR_SUSPENDED)
+			return handled;
+
+		handled += (int)n;
+	}
+
+	while (!reentrant && !q_empty(a->self_q) && handled < SELF_DRAIN_LIMIT) {
+		run[0] = q_front(a->self_q);
+
+		if (q_pop(a->self_q) != Q_SUCCESS)
+			return ACTOR_ERROR;
+
+		n = actor_take_run(a, a->self_q, run, &b, &stale);
+
+		if ((ret = actor_handle_run(a, run, n, b, stale, t_num)) == ACTOR_ERROR)
+			return ACTOR_ERROR;
+
+		if (ret == ACTOR_SUSPENDED)
+			return handled;
+
+		handled += (int)n;
+	}
+
+	return handled;
+}
+
+// the worker lets go of the actor, which goes to the back of the thread queue
+// if it still has messages
+static int actor_yield(actor_t* a, bool reentrant) {
+	actor_lock(a);
+
+	// a suspended actor stays scheduled, so nothing else runs it until it is resumed
+	bool suspended = a->coro != NULL;
+	bool requeue;
+
+	--(a->scheduled);
+
+	if (a->reentrant) {
+		// what it sent itself before it became reentrant is handed to all its workers
+		while (!reentrant && !q_empty(a->self_q)) {
+			if (actor_mailbox(a) == NULL || q_push(a->msg_q, q_front(a->self_q)) != Q_SUCCESS
+					|| q_pop(a->self_q) != Q_SUCCESS) {
+				actor_unlock(a);
+				return ACTOR_ERROR;
+			}
+		}
+
+		requeue = !q_empty(a->msg_q) && actor_claim(a);
+	}
+	else {
+		requeue = !suspended && (!q_empty(a->msg_q) || !q_empty(a->self_q));
+
+		if (!requeue && !suspended && a->pool != NULL && !a->dead)
+			requeue = group_idle(a->pool, a);
+
+		if (requeue || suspended)
+			++(a->scheduled);
+	}
+
+	// an idle actor keeps no mailbox; the next message brings a new one
+	q_t* msg_q = NULL;
+	q_t* self_q = NULL;
+
+	if (a->scheduled == 0) {
+		msg_q = a->msg_q;
+		self_q = a->self_q;
+		a->msg_q = NULL;
+		a->self_q = NULL;
+	}
+
+	actor_unlock(a);
+
+	// freed outside the spin lock, which is only held for a few stores
+	q_destroy(&msg_q);
+	q_destroy(&self_q);
+
+	if (requeue && tp_notify(a) != 0)
+		return ACTOR_ERROR;
+
+	return ACTOR_SUCCESS;
+}
+
+
+// tq - thread queue, runnable actors by stride pass: an actor's pass advances by
+// its stride for every message it handles, and the lowest pass runs next, so
+// actors share the workers in proportion to their weights
+
+typedef struct tq_entry {
+	actor_t* actor;
+	long long stamp;
+	long long pass;
+	long long seq;
+} tq_entry_t;
+
+typedef struct tq {
+	int cur_len;
+	int max_len;
+	tq_entry_t* actors;
+	// the pass of the last actor taken; an actor that was idle restarts from it
+	long long vtime;
+	long long seq;
+} tq_t;
+
+static tq_t* tq_init() {
+	tq_t* q = (tq_t*)malloc(sizeof(tq_t));
+	if (q == NULL)
+		return NULL;
+	
+	q->cur_len = 0;
+	q->max_len = 2;
+	q->vtime = 0;
+	q->seq = 0;
+
+	q->actors = (tq_entry_t*)malloc(sizeof(tq_entry_t) * 2);
+	if (q->actors == NULL) {
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+static void tq_destroy(tq_t** q) {
+	if (*q != NULL) {
+		if ((*q)->actors != NULL)
+			free((*q)->actors);
+		free(*q);
+	}
+}
+
+static int tq_size(tq_t* q) {
+	if (q == NULL || q->actors == NULL)
+		return 0;
+	else
+		return q->cur_len;
+}
+
+static bool tq_empty(tq_t* q) {
+	return tq_size(q) <= 0;
+}
+
+#define TQ_SUCCESS 0
+#define TQ_EMPTY 1
+#define TQ_BAD_ALLOC -1
+
+// equal passes run in the order they were queued
+static bool tq_before(tq_entry_t* x, tq_entry_t* y) {
+	return x->pass < y->pass || (x->pass == y->pass && x->seq < y->seq);
+}
+
+static void tq_swap(tq_t* q, int i, int j) {
+	tq_entry_t tmp = q->actors[i];
+	q->actors[i] = q->actors[j];
+	q->actors[j] = tmp;
+}
+
+static int tq_resize(tq_t* q, int max_len) {
+	tq_entry_t* new_actors = (tq_entry_t*)realloc(q->actors, sizeof(tq_entry_t) * max_len);
+	if (new_actors == NULL)
+		return TQ_BAD_ALLOC;
+
+	q->actors = new_actors;
+	q->max_len = max_len;
+	return TQ_SUCCESS;
+}
+
+static int tq_push(tq_t* q, tq_entry_t a) {
+	if (q->cur_len + 1 >= q->max_len && tq_resize(q, q->max_len * 2) != TQ_SUCCESS)
+		return TQ_BAD_ALLOC;
+
+	if (a.pass < q->vtime)
+		a.pass = q->vtime;
+	a.seq = q->seq++;
+
+	int i = q->cur_len++;
+	q->actors[i] = a;
+
+	while (i > 0 && tq_before(&(q->actors[i]), &(q->actors[(i - 1) / 2]))) {
+		tq_swap(q, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+
+	return TQ_SUCCESS;
+}
+
+static int tq_pop(tq_t* q) {
+	if (tq_empty(q))
+		return TQ_EMPTY;
+
+	q->vtime = q->actors[0].pass;
+	q->actors[0] = q->actors[--(q->cur_len)];
+
+	for (int i = 0; ; ) {
+		int least = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+
+		if (l < q->cur_len && tq_before(&(q->actors[l]), &(q->actors[least])))
+			least = l;
+		if (r < q->cur_len && tq_before(&(q->actors[r]), &(q->actors[least])))
+			least = r;
+		if (least == i)
+			break;
+
+		tq_swap(q, i, least);
+		i = least;
+	}
+
+	if (q->max_len > 2 && q->cur_len < q->max_len / 4)
+		tq_resize(q, q->max_len / 2);
+
+	return TQ_SUCCESS;
+}
+
+static tq_entry_t tq_front(tq_t* q) {
+	return q->actors[0];
+}
+
+// tp - thread pool
+#define SLOT_FREE 0
+#define SLOT_LIVE 1
+#define SLOT_RETIRED 2
+
+typedef struct thread_pool {
+	int capacity;
+	pthread_t* threads;
+	actor_t** current_actor;
+	actor_t** run_next;
+	void* keys;
+	tq_t* thread_queue;
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t wait_on_q;
+	int idle;
+
+	// workers park here between actor systems
+	pthread_mutex_t park_mutex;
+	pthread_cond_t park;
+	long generation;
+	bool exiting;
+	int* slots;
+	int live;
+	int working;
+} tp_t;
+
+static tp_t* tp_init(int capacity) {
+	tp_t* tp = (tp_t*)malloc(sizeof(tp_t));
+	if (tp == NULL)
+		return NULL;
+
+	tp->capacity = capacity;
+	tp->threads = (pthread_t*)malloc(sizeof(pthread_t) * capacity);
+
+	if (tp->threads == NULL) {
+		free(tp);
+		return NULL;
+	}
+
+	tp->current_actor = (actor_t**)calloc(capacity, sizeof(actor_t*));
+
+	if (tp->current_actor == NULL) {
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	tp->run_next = (actor_t**)calloc(capacity, sizeof(actor_t*));
+
+	if (tp->run_next == NULL) {
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	tp->keys = malloc(sizeof(int) * capacity);
+
+	if (tp->keys == NULL) {
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	tp->slots = (int*)malloc(sizeof(int) * capacity);
+
+	if (tp->slots == NULL) {
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	int* keys = (int*)tp->keys;
+
+	for (int i = 0; i < capacity; ++i) {
+		keys[i] = i;
+		tp->slots[i] = SLOT_FREE;
+	}
+
+	if (pthread_mutex_init(&(tp->queue_mutex), NULL) != 0) {
+		free(tp->slots);
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&(tp->wait_on_q), NULL) != 0) {
+		pthread_mutex_destroy(&(tp->queue_mutex));
+		free(tp->slots);
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	if ((tp->thread_queue = tq_init()) == NULL) {
+		pthread_cond_destroy(&(tp->wait_on_q));
+		pthread_mutex_destroy(&(tp->queue_mutex));
+		free(tp->slots);
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&(tp->park_mutex), NULL) != 0) {
+		tq_destroy(&(tp->thread_queue));
+		pthread_cond_destroy(&(tp->wait_on_q));
+		pthread_mutex_destroy(&(tp->queue_mutex));
+		free(tp->slots);
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&(tp->park), NULL) != 0) {
+		pthread_mutex_destroy(&(tp->park_mutex));
+		tq_destroy(&(tp->thread_queue));
+		pthread_cond_destroy(&(tp->wait_on_q));
+		pthread_mutex_destroy(&(tp->queue_mutex));
+		free(tp->slots);
+		free(tp->keys);
+		free(tp->run_next);
+		free(tp->current_actor);
+		free(tp->threads);
+		free(tp);
+		return NULL;
+	}
+
+	tp->idle = 0;
+	tp->generation = 0;
+	tp->exiting = false;
+	tp->live = 0;
+	tp->working = 0;
+
+	return tp;
+}
+
+static void tp_destroy(tp_t** tp) {
+	pthread_cond_destroy(&((*tp)->park));
+	pthread_mutex_destroy(&((*tp)->park_mutex));
+	tq_destroy(&((*tp)->thread_queue));
+	pthread_cond_destroy(&((*tp)->wait_on_q));
+	pthread_mutex_destroy(&((*tp)->queue_mutex));
+	free((*tp)->slots);
+	free((*tp)->run_next);
+	free((*tp)->current_actor);
+	free((*tp)->keys);
+	free((*tp)->threads);
+	free(*tp);
+	*tp = NULL;
+}
+
+// Module state
+static _Atomic int running = 0;
+static _Atomic bool killed;
+// transports hand messages in only between the system's start and teardown
+static _Atomic bool node_open;
+static _Atomic int node_entering;
+static tp_t* thread_pool;
+static actor_config_t config;
+static actor_config_t system_config;
+static _Atomic int hold_released;
+
+// messages a quiescent system waits for from outside, like pending reads, each
+// counted in in_flight; a new system or a shutdown starts a new epoch, and the
+// holds of the old one are given back as nothing
+static pthread_mutex_t hold_lock = PTHREAD_MUTEX_INITIALIZER;
+static long pending_holds;
+static unsigned hold_epoch;
+
+// worker bounds of the running system; elastic when they differ
+static int min_workers;
+static int max_workers;
+static bool elastic;
+// how long an idle worker above min_workers lingers, never when negative
+static long idle_retire_ms;
+// the controller samples the thread queue while set; guarded by queue_mutex
+static _Atomic bool control_armed;
+
+// the thread queue backs up with no worker idle
+#define CONTROL_WAKE 'c'
+
+static void shutdown_notify(char c);
+
+// the system has no workers of its own and runs on the thread that joins it
+static bool inline_mode;
+// some thread is running the inline system as worker 0
+static _Atomic bool inline_busy;
+// the first joiner runs an inline system, the others wait for it
+static bool inline_claimed;
+
+// wakes every idle worker so that it notices the system is over
+static void tp_finish() {
+	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+
+	killed = true;
+
+	if (pthread_cond_broadcast(&(thread_pool->wait_on_q)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+}
+
+// nothing queued or running anymore - in quiescent mode that ends the system,
+// otherwise it does once every actor got MSG_GODIE
+static void tp_message_done(long handled) {
+	if ((in_flight -= handled) != 0)
+		return;
+
+	bool done = closing || system_config.termination == ACTOR_TERMINATE_QUIESCENT;
+
+	if (!done) {
+		if (pthread_mutex_lock(&state_counters_lock) != 0)
+			exit(-1);
+
+		done = actors_finished == count_actors;
+
+		if (pthread_mutex_unlock(&state_counters_lock) != 0)
+			exit(-1);
+	}
+
+	if (done)
+		tp_finish();
+}
+
+static int tp_notify(actor_t* a) {
+	tq_entry_t entry;
+	entry.actor = a;
+	entry.stamp = elastic ? clock_ns() : 0;
+	entry.pass = a->pass;
+
+	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+		return -1;
+
+	int ret = tq_push(thread_pool->thread_queue, entry);
+
+	// an actor that was idle does not get to spend the passes it missed
+	if (a->pass < thread_pool->thread_queue->vtime)
+		a->pass = thread_pool->thread_queue->vtime;
+
+	if (ret != TQ_SUCCESS) {
+		pthread_mutex_unlock(&(thread_pool->queue_mutex));
+		return -1;
+	}
+
+	// nobody idle to take it - the controller watches the queue until it drains;
+	// woken under the lock, before a finishing system can take the coordinator down
+	if (elastic && thread_pool->idle == 0 && !control_armed && !killed) {
+		control_armed = true;
+		shutdown_notify(CONTROL_WAKE);
+	}
+
+	if (pthread_cond_signal(&(thread_pool->wait_on_q)) != 0) {
+		pthread_mutex_unlock(&(thread_pool->queue_mutex));
+		return -1;
+	}
+
+	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+		return -1;
+
+	return 0;
+}
+
+// a worker that wakes an actor runs it straight after the current message;
+// whatever sat in its slot is moved to the thread queue where anyone can take it
+static int tp_run_next(int worker, actor_t* a) {
+	actor_t* displaced = thread_pool->run_next[worker];
+	thread_pool->run_next[worker] = a;
+
+	if (displaced != NULL)
+		return tp_notify(displaced);
+
+	return 0;
+}
+
+// set while the actors are destroyed, when promises still break but nobody resumes
+static bool destroying;
+
+// the actor is runnable again once the promise its handler waits on settles
+static void actor_resume(actor_t* a) {
+	if (!destroying && tp_notify(a) != 0)
+		exit(-1);
+}
+
+static void actor_park(actor_t* a, promise_t* p) {
+	if (pthread_mutex_lock(&(p->lock)) != 0)
+		exit(-1);
+
+	bool pending = p->state == PROMISE_PENDING;
+
+	if (pending)
+		p->waiter = a;
+
+	if (pthread_mutex_unlock(&(p->lock)) != 0)
+		exit(-1);
+
+	if (!pending)
+		actor_resume(a);
+}
+
+// sleep - promises a single thread settles when their time comes
+typedef struct sleeper {
+	struct timespec due;
+	promise_t* promise;
+} sleeper_t;
+
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t sleep_thread;
+static bool sleep_started = false;
+static bool sleep_quit;
+static sleeper_t* sleepers = NULL;
+static size_t nsleepers = 0;
+static size_t sleepers_cap = 0;
+
+static bool ts_before(struct timespec const* x, struct timespec const* y) {
+	return x->tv_sec < y->tv_sec || (x->tv_sec == y->tv_sec && x->tv_nsec < y->tv_nsec);
+}
+
+static void* sleep_running(void* arg) {
+	(void)arg;
+	message_t none = {MSG_HELLO, 0, NULL};
+
+	if (pthread_mutex_lock(&sleep_lock) != 0)
+		exit(-1);
+
+	while (!sleep_quit) {
+		if (nsleepers == 0) {
+			if (pthread_cond_wait(&sleep_cond, &sleep_lock) != 0)
+				exit(-1);
+			continue;
+		}
+
+		size_t first = 0;
+		for (size_t i = 1; i < nsleepers; ++i) {
+			if (ts_before(&(sleepers[i].due), &(sleepers[first].due)))
+				first = i;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		if (ts_before(&now, &(sleepers[first].due))) {
+			int ret = pthread_cond_timedwait(&sleep_cond, &sleep_lock, &(sleepers[first].due));
+			if (ret != 0 && ret != ETIMEDOUT)
+				exit(-1);
+			continue;
+		}
+
+		promise_t* p = sleepers[first].promise;
+		sleepers[first] = sleepers[--nsleepers];
+
+		if (pthread_mutex_unlock(&sleep_lock) != 0)
+			exit(-1);
+
+		promise_settle(p, PROMISE_READY, none);
+
+		if (pthread_mutex_lock(&sleep_lock) != 0)
+			exit(-1);
+	}
+
+	if (pthread_mutex_unlock(&sleep_lock) != 0)
+		exit(-1);
+
+	return NULL;
+}
+
+static int sleep_add(promise_t* p, long ms) {
+	if (pthread_mutex_lock(&sleep_lock) != 0)
+		exit(-1);
+
+	if (nsleepers == sleepers_cap) {
+		size_t cap = sleepers_cap > 0 ? sleepers_cap * 2 : 16;
+		sleeper_t* grown = (sleeper_t*)realloc(sleepers, sizeof(sleeper_t) * cap);
+
+		if (grown == NULL) {
+			pthread_mutex_unlock(&sleep_lock);
+			return -1;
+		}
+
+		sleepers = grown;
+		sleepers_cap = cap;
+	}
+
+	if (!sleep_started) {
+		sleep_quit = false;
+
+		if (pthread_create(&sleep_thread, NULL, sleep_running, NULL) != 0) {
+			pthread_mutex_unlock(&sleep_lock);
+			return -1;
+		}
+
+		sleep_started = true;
+	}
+
+	sleeper_t* sl = &(sleepers[nsleepers++]);
+	clock_gettime(CLOCK_REALTIME, &(sl->due));
+	sl->due.tv_sec += ms / 1000;
+	sl->due.tv_nsec += (ms % 1000) * 1000000;
+	if (sl->due.tv_nsec >= 1000000000) {
+		sl->due.tv_nsec -= 1000000000;
+		++(sl->due.tv_sec);
+	}
+	sl->promise = p;
+
+	if (pthread_cond_signal(&sleep_cond) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&sleep_lock) != 0)
+		exit(-1);
+
+	return 0;
+}
+
+// ends the sleep thread with the system; the handlers still sleeping never wake
+static void sleep_stop() {
+	if (pthread_mutex_lock(&sleep_lock) != 0)
+		exit(-1);
+
+	bool started = sleep_started;
+	sleep_quit = true;
+
+	if (pthread_cond_signal(&sleep_cond) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&sleep_lock) != 0)
+		exit(-1);
+
+	if (started && pthread_join(sleep_thread, NULL) != 0)
+		exit(-1);
+
+	for (size_t i = 0; i < nsleepers; ++i) {
+		sleepers[i].promise->waiter = NULL;
+		promise_release(sleepers[i].promise);
+	}
+
+	free(sleepers);
+	sleepers = NULL;
+	nsleepers = sleepers_cap = 0;
+	sleep_started = false;
+}
+
+static pthread_mutex_t join_mutex;
+static pthread_cond_t waiting_to_endoperating;
+static pthread_cond_t waiting_to_enddestroying;
+static bool finished_operating;
+static int joining;
+static bool finished_destroying;
+static int toexit;
+
+static _Atomic int destroyed;
+static bool registered_finished_operating;
+
+// Shutdown coordinator, also the controller of an elastic pool
+#define ELASTIC_TICK_MS 1
+#define ELASTIC_GROW_TICKS 2
+#define ELASTIC_GROW_LATENCY_NS 1000000LL
+
+#define SHUTDOWN_BEGIN 's'
+#define SHUTDOWN_QUIT 'q'
+
+static int shutdown_pipe[2] = {-1, -1};
+static pthread_t coordinator;
+static bool coordinator_started;
+static struct sigaction prev_sigint;
+
+static void shutdown_notify(char c) {
+	int saved_errno = errno;
+	while (write(shutdown_pipe[1], &c, 1) < 0 && errno == EINTR);
+	errno = saved_errno;
+}
+
+static void stop_tp(int signo) {
+	(void)signo;
+	shutdown_notify(SHUTDOWN_BEGIN);
+}
+
+static void set_sigint() {
+	struct sigaction sigint_action;
+	sigint_action.sa_handler = stop_tp;
+	sigemptyset(&sigint_action.sa_mask);
+	sigint_action.sa_flags = SA_RESTART | SA_RESETHAND;
+	sigaction(SIGINT, &sigint_action, &prev_sigint);
+}
+
+static void reset_sigint() {
+	sigaction(SIGINT, &prev_sigint, NULL);
+}
+
+// counted when the holds are still part of this system's in_flight
+static void holds_forget(bool counted) {
+	if (pthread_mutex_lock(&hold_lock) != 0)
+		exit(-1);
+
+	if (counted)
+		in_flight -= pending_holds;
+
+	pending_holds = 0;
+
+	// 0 is never a valid token
+	if (++hold_epoch == 0)
+		++hold_epoch;
+
+	if (pthread_mutex_unlock(&hold_lock) != 0)
+		exit(-1);
+}
+
+static void shutdown_begin() {
+	closing = true;
+
+	// what the system still waits for from outside is not worth waiting for anymore
+	holds_forget(true);
+
+	if (system_config.termination == ACTOR_TERMINATE_QUIESCENT && hold_released++ == 0)
+		--in_flight;
+
+	if (in_flight == 0)
+		tp_finish();
+}
+
+static void tp_control();
+
+static long ms_since(struct timespec const* start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void* coordinator_running(void* arg) {
+	(void)arg;
+
+	struct timespec shutdown_start;
+	struct timespec last_tick;
+	bool shutting_down = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &last_tick);
+
+	while (true) {
+		int timeout = -1;
+
+		if (shutting_down && system_config.drain_deadline_ms > 0) {
+			long left = system_config.drain_deadline_ms - ms_since(&shutdown_start);
+
+			// past the drain deadline - workers stop, whatever is queued gets dropped
+			if (left <= 0) {
+				tp_finish();
+				shutting_down = false;
+				continue;
+			}
+
+			timeout = (int)left;
+		}
+
+		// an idle or keeping-up pool leaves the controller asleep
+		if (elastic && control_armed && (timeout < 0 || timeout > ELASTIC_TICK_MS))
+			timeout = ELASTIC_TICK_MS;
+
+		struct pollfd pfd;
+		pfd.fd = shutdown_pipe[0];
+		pfd.events = POLLIN;
+
+		int ret = poll(&pfd, 1, timeout);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			exit(-1);
+
+		if (elastic && control_armed && ms_since(&last_tick) >= ELASTIC_TICK_MS) {
+			clock_gettime(CLOCK_MONOTONIC, &last_tick);
+			tp_control();
+		}
+
+		if (ret == 0)
+			continue;
+
+		char c;
+		if (read(shutdown_pipe[0], &c, 1) != 1)
+			continue;
+
+		if (c == SHUTDOWN_QUIT)
+			break;
+
+		// the first sample is a tick away, so a burst has to last to grow the pool
+		if (c == CONTROL_WAKE)
+			clock_gettime(CLOCK_MONOTONIC, &last_tick);
+
+		if (c == SHUTDOWN_BEGIN && !closing) {
+			clock_gettime(CLOCK_MONOTONIC, &shutdown_start);
+			shutting_down = true;
+			shutdown_begin();
+		}
+	}
+
+	return 0;
+}
+
+static bool coordinator_init() {
+	if (pipe(shutdown_pipe) != 0)
+		return false;
+
+	if (pthread_create(&coordinator, NULL, coordinator_running, NULL) != 0) {
+		close(shutdown_pipe[0]);
+		close(shutdown_pipe[1]);
+		return false;
+	}
+
+	coordinator_started = true;
+	set_sigint();
+	return true;
+}
+
+static void coordinator_destroy() {
+	if (!coordinator_started)
+		return;
+
+	reset_sigint();
+	shutdown_notify(SHUTDOWN_QUIT);
+	pthread_join(coordinator, NULL);
+	close(shutdown_pipe[0]);
+	close(shutdown_pipe[1]);
+	coordinator_started = false;
+}
+
+static void* thread_running(void* t_number);
+
+// assumes you have thread_pool->park_mutex acquired
+static void tp_spawn() {
+	for (int i = 0; i < thread_pool->capacity; ++i) {
+		if (thread_pool->slots[i] == SLOT_FREE) {
+			thread_pool->slots[i] = SLOT_LIVE;
+			++(thread_pool->live);
+
+			if (pthread_create(&(thread_pool->threads[i]),
+							NULL,
+							thread_running,
+							(void*)&(((int*)(thread_pool->keys))[i])) != 0) {
+				exit(-1);
+			}
+			return;
+		}
+	}
+}
+
+// assumes you have thread_pool->park_mutex acquired
+static void tp_reap() {
+	for (int i = 0; i < thread_pool->capacity; ++i) {
+		if (thread_pool->slots[i] == SLOT_RETIRED) {
+			if (pthread_join(thread_pool->threads[i], NULL) != 0)
+				exit(-1);
+			thread_pool->slots[i] = SLOT_FREE;
+		}
+	}
+}
+
+static bool tp_start() {
+	if (thread_pool != NULL)
+		return true;
+
+	if ((thread_pool = tp_init(max_workers)) == NULL)
+		return false;
+
+	if (pthread_key_create(&thread_number, NULL) != 0) {
+		tp_destroy(&thread_pool);
+		return false;
+	}
+
+	return true;
+}
+
+// hands the parked workers over to a freshly created system
+static void tp_attach() {
+	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+
+	tq_t* q = thread_pool->thread_queue;
+	q->cur_len = 0;
+	q->vtime = 0;
+
+	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	tp_reap();
+
+	while (!inline_mode && thread_pool->live < min_workers)
+		tp_spawn();
+
+	// an inline system's only worker is the thread that joins it
+	thread_pool->working = inline_mode ? 1 : thread_pool->live;
+	++(thread_pool->generation);
+
+	if (pthread_cond_broadcast(&(thread_pool->park)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+}
+
+static void tp_stop() {
+	if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	thread_pool->exiting = true;
+
+	if (pthread_cond_broadcast(&(thread_pool->park)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	for (int i = 0; i < thread_pool->capacity; ++i) {
+		if (thread_pool->slots[i] != SLOT_FREE && pthread_join(thread_pool->threads[i], NULL) != 0)
+			exit(-1);
+	}
+
+	pthread_key_delete(thread_number);
+	tp_destroy(&thread_pool);
+}
+
+static int pressure_ticks;
+
+// grows the pool while the thread queue stays deep or slow with no worker idle
+static void tp_control() {
+	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+
+	int depth = tq_size(thread_pool->thread_queue);
+	int idle = thread_pool->idle;
+	long long waited = depth > 0 ? clock_ns() - tq_front(thread_pool->thread_queue).stamp : 0;
+
+	// disarmed under the lock, so the next backlog tp_notify sees arms it again
+	if (depth == 0 || idle > 0)
+		control_armed = false;
+
+	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	tp_reap();
+
+	bool pressure = idle == 0 && depth > 0
+		&& (depth >= thread_pool->live || waited >= ELASTIC_GROW_LATENCY_NS);
+	pressure_ticks = pressure ? pressure_ticks + 1 : 0;
+
+	if (pressure_ticks >= ELASTIC_GROW_TICKS && thread_pool->live < max_workers
+			&& thread_pool->working > 0 && !killed) {
+		++(thread_pool->working);
+		tp_spawn();
+		pressure_ticks = 0;
+	}
+
+	if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+}
+
+static void module_destroy_state() {
+	node_open = false;
+	while (node_entering > 0)
+		sched_yield();
+
+	destroying = true;
+	sleep_stop();
+	coordinator_destroy();
+	pthread_cond_destroy(&waiting_to_endoperating);
+	pthread_mutex_destroy(&state_counters_lock);
+
+	if (!system_config.warm_pool)
+		tp_stop();
+
+	for (size_t i = 0; i < count_actors; ++i) {
+		if (actors[i] != NULL) {
+			actor_destroy(&(actors[i]));
+		}
+	}
+
+	slab_release();
+}
+
+static void tp_join() {
+	if (pthread_mutex_lock(&join_mutex) != 0)
+		exit(-1);
+	++toexit;
+
+	if (!registered_finished_operating) {
+		++joining;
+		while (!finished_operating) {
+			if (pthread_cond_wait(&waiting_to_endoperating, &join_mutex) != 0)
+				exit(-1);
+		}
+		registered_finished_operating = true;
+		--joining;
+		if (joining == 0) {
+			if (pthread_mutex_unlock(&join_mutex) != 0)
+				exit(-1);
+
+			module_destroy_state();
+
+			if (pthread_mutex_lock(&join_mutex) != 0)
+				exit(-1);
+
+			finished_destroying = true;
+			if (pthread_cond_broadcast(&waiting_to_enddestroying) != 0)
+				exit(-1);
+		}
+	}
+	while (!finished_destroying) {
+		if (pthread_cond_wait(&waiting_to_enddestroying, &join_mutex) != 0)
+				exit(-1);
+	}
+
+	--toexit;
+
+	if (pthread_mutex_unlock(&join_mutex) != 0)
+		exit(-1);
+	
+	if (toexit == 0 && destroyed++ == 0) {
+		pthread_cond_destroy(&waiting_to_enddestroying);
+		pthread_mutex_destroy(&join_mutex);
+		count_actors = 0;
+		running = 0;
+	}
+}
+
+static bool module_init_state() {
+	if (running++ != 0)
+		return false;
+	
+	killed = false;
+	closing = false;
+	destroying = false;
+	dropped = 0;
+	shed_count = 0;
+	system_config = config;
+	in_flight = system_config.termination == ACTOR_TERMINATE_QUIESCENT ? 1 : 0;
+	hold_released = 0;
+	holds_forget(false);
+	finished_operating = false;
+	joining = 0;
+	finished_destroying = false;
+	toexit = 0;
+	count_actors = 0;
+	actors_finished = 0;
+	pressure_ticks = 0;
+	min_workers = system_config.min_workers > 0 ? system_config.min_workers : POOL_SIZE;
+	max_workers = system_config.max_workers > min_workers ? system_config.max_workers : min_workers;
+	inline_mode = system_config.executor == ACTOR_EXECUTOR_INLINE
+		|| (system_config.executor == ACTOR_EXECUTOR_AUTO && max_workers == 1);
+
+	if (inline_mode)
+		min_workers = max_workers = 1;
+
+	elastic = max_workers > min_workers;
+	idle_retire_ms = system_config.idle_retire_ms != 0 ? system_config.idle_retire_ms : IDLE_RETIRE_MS;
+	control_armed = false;
+	inline_busy = false;
+	inline_claimed = false;
+	destroyed = 0;
+	registered_finished_operating = false;
+
+	if (thread_pool != NULL && (thread_pool->capacity != max_workers || (inline_mode && thread_pool->live > 0)))
+		tp_stop();
+
+	if (!tp_start()) {
+		running = 0;
+		return false;
+	}
+
+	if (pthread_mutex_init(&state_counters_lock, NULL) != 0) {
+		tp_stop();
+		running = 0;
+		return false;
+	}
+
+	if (pthread_mutex_init(&join_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&state_counters_lock);
+		tp_stop();
+		running = 0;
+		return false;
+	}
+
+	if (pthread_cond_init(&waiting_to_endoperating, NULL) != 0) {
+		pthread_mutex_destroy(&join_mutex);
+		pthread_mutex_destroy(&state_counters_lock);
+		tp_stop();
+		running = 0;
+		return false;
+	}
+
+	if (pthread_cond_init(&waiting_to_enddestroying, NULL) != 0) {
+		pthread_cond_destroy(&waiting_to_endoperating);
+		pthread_mutex_destroy(&join_mutex);
+		pthread_mutex_destroy(&state_counters_lock);
+		tp_stop();
+		running = 0;
+		return false;
+	}
+
+	if (!inline_mode && !coordinator_init()) {
+		pthread_cond_destroy(&waiting_to_enddestroying);
+		pthread_cond_destroy(&waiting_to_endoperating);
+		pthread_mutex_destroy(&join_mutex);
+		pthread_mutex_destroy(&state_counters_lock);
+		tp_stop();
+		running = 0;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Threads
+static bool tp_retire(size_t t_num) {
+	bool retire = false;
+
+	if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	if (thread_pool->live > min_workers) {
+		thread_pool->slots[t_num] = SLOT_RETIRED;
+		--(thread_pool->live);
+		--(thread_pool->working);
+		retire = true;
+	}
+
+	if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+		exit(-1);
+
+	return retire;
+}
+
+// assumes you have thread_pool->queue_mutex acquired
+static int tp_idle_wait() {
+	int ret;
+
+	++(thread_pool->idle);
+
+	if (elastic && idle_retire_ms > 0) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += idle_retire_ms / 1000;
+		deadline.tv_nsec += (idle_retire_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_nsec -= 1000000000;
+			++deadline.tv_sec;
+		}
+
+		ret = pthread_cond_timedwait(&(thread_pool->wait_on_q), &(thread_pool->queue_mutex), &deadline);
+	}
+	else {
+		ret = pthread_cond_wait(&(thread_pool->wait_on_q), &(thread_pool->queue_mutex));
+	}
+
+	--(thread_pool->idle);
+
+	if (ret != 0 && ret != ETIMEDOUT)
+		exit(-1);
+
+	return ret;
+}
+
+static void tp_exec(actor_t* a, size_t t_num) {
+	thread_pool->current_actor[t_num] = a;
+
+	// whether it is reentrant may change while it runs, but not for this turn
+	bool reentrant = a->reentrant;
+	int handled = actor_exec(a, (int)t_num, reentrant);
+
+	if (handled == ACTOR_ERROR)
+		exit(-1);
+
+	a->pass += a->stride * (handled > 0 ? handled : 1);
+
+	promise_t* awaiting = a->awaiting;
+
+	if (awaiting != NULL)
+		a->awaiting = NULL;
+
+	if (actor_yield(a, reentrant) != ACTOR_SUCCESS)
+		exit(-1);
+
+	// only now may whoever settles the promise hand the actor to another worker
+	if (awaiting != NULL)
+		actor_park(a, awaiting);
+
+	if (handled > 0)
+		tp_message_done(handled);
+}
+
+#define RUN_NEXT_LIMIT 64
+
+// returns true if the worker retired from the pool
+static bool tp_work(size_t t_num) {
+	int chained = 0;
+	actor_t** run_next = &(thread_pool->run_next[t_num]);
+
+	while (true) {
+		actor_t* a = *run_next;
+
+		if (a != NULL) {
+			*run_next = NULL;
+
+			// a long handoff chain must not starve the thread queue
+			if (++chained > RUN_NEXT_LIMIT) {
+				if (tp_notify(a) != 0)
+					exit(-1);
+				a = NULL;
+			}
+		}
+
+		if (a != NULL && !killed) {
+			tp_exec(a, t_num);
+			continue;
+		}
+
+		chained = 0;
+
+		if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+			exit(-1);
+
+		while (tq_empty(thread_pool->thread_queue) && !killed) {
+			if (tp_idle_wait() == ETIMEDOUT && tq_empty(thread_pool->thread_queue)
+					&& !killed && tp_retire(t_num)) {
+				if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+					exit(-1);
+				return true;
+			}
+		}
+
+		if (killed) {
+			if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+				exit(-1);
+			break;
+		}
+
+		a = tq_front(thread_pool->thread_queue).actor;
+		tq_pop(thread_pool->thread_queue);
+
+		if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+			exit(-1);
+
+		tp_exec(a, t_num);
+	}
+
+	*run_next = NULL;
+	tp_finish();
+	return false;
+}
+
+static void* thread_running(void* t_number) {
+	if (pthread_setspecific(thread_number, t_number) != 0)
+		exit(-1);
+
+	size_t t_num = (size_t)(*((int*)t_number));
+	long generation = 0;
+
+	while (true) {
+		if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+			exit(-1);
+
+		while (thread_pool->generation == generation && !thread_pool->exiting) {
+			if (pthread_cond_wait(&(thread_pool->park), &(thread_pool->park_mutex)) != 0)
+				exit(-1);
+		}
+
+		bool exiting = thread_pool->exiting;
+		generation = thread_pool->generation;
+
+		if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+			exit(-1);
+
+		if (exiting)
+			break;
+
+		if (tp_work(t_num))
+			break;
+
+		if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+			exit(-1);
+
+		bool last = --(thread_pool->working) == 0;
+
+		if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+			exit(-1);
+
+		if (last) {
+			if (pthread_mutex_lock(&join_mutex) != 0)
+				exit(-1);
+
+			finished_operating = true;
+			if (pthread_cond_broadcast(&waiting_to_endoperating) != 0)
+				exit(-1);
+
+			if (pthread_mutex_unlock(&join_mutex) != 0)
+				exit(-1);
+		}
+	}
+
+	return 0;
+}
+
+static bool inline_enter() {
+	bool expected = false;
+
+	if (!atomic_compare_exchange_strong(&inline_busy, &expected, true))
+		return false;
+
+	if (pthread_setspecific(thread_number, &(((int*)(thread_pool->keys))[0])) != 0)
+		exit(-1);
+
+	return true;
+}
+
+static void inline_leave() {
+	if (pthread_setspecific(thread_number, NULL) != 0)
+		exit(-1);
+
+	inline_busy = false;
+}
+
+// one actor turn on the calling thread; false when nothing is runnable
+static bool inline_step() {
+	actor_t* a = thread_pool->run_next[0];
+	thread_pool->run_next[0] = NULL;
+
+	if (a == NULL) {
+		if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+			exit(-1);
+
+		if (!tq_empty(thread_pool->thread_queue) && !killed) {
+			a = tq_front(thread_pool->thread_queue).actor;
+			tq_pop(thread_pool->thread_queue);
 		}
 
-		free(q->actors);
-		q->actors = new_actors;
-		q->front = 0;
-		q->back = q->cur_len - 1;
-		q->max_len *= 2;
+		if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+			exit(-1);
+	}
+
+	if (a == NULL)
+		return false;
+
+	tp_exec(a, 0);
+	return true;
+}
+
+// the joining thread works as the system's only worker until it ends
+static void inline_run() {
+	if (pthread_mutex_lock(&join_mutex) != 0)
+		exit(-1);
+
+	bool claimed = inline_claimed;
+	inline_claimed = true;
+
+	if (pthread_mutex_unlock(&join_mutex) != 0)
+		exit(-1);
+
+	if (claimed)
+		return;
+
+	// a caller in future_wait only holds the system for a few turns
+	while (!inline_enter())
+		sched_yield();
+
+	tp_work(0);
+	inline_leave();
+
+	if (pthread_mutex_lock(&join_mutex) != 0)
+		exit(-1);
+
+	finished_operating = true;
+
+	if (pthread_cond_broadcast(&waiting_to_endoperating) != 0)
+		exit(-1);
+
+	if (pthread_mutex_unlock(&join_mutex) != 0)
+		exit(-1);
+}
+
+
+// Interface
+void actor_system_join(actor_id_t actor) {
+	actor_t* a = actor_get(actor);
+	if (a == NULL)
+		exit(-1);
+
+	if (system_config.termination == ACTOR_TERMINATE_QUIESCENT && hold_released++ == 0)
+		tp_message_done(1);
+
+	if (inline_mode)
+		inline_run();
+
+	tp_join();
+}
+
+void actor_config_default(actor_config_t* cfg) {
+	cfg->termination = ACTOR_TERMINATE_GODIE;
+	cfg->drain_deadline_ms = 0;
+	cfg->warm_pool = false;
+	cfg->min_workers = POOL_SIZE;
+	cfg->max_workers = POOL_SIZE;
+	cfg->idle_retire_ms = IDLE_RETIRE_MS;
+	cfg->executor = ACTOR_EXECUTOR_POOL;
+}
+
+int actor_system_configure(actor_config_t const* cfg) {
+	if (running != 0)
+		return -1;
+
+	config = *cfg;
+	return 0;
+}
+
+void actor_config_get(actor_config_t* cfg) {
+	*cfg = config;
+}
+
+void actor_system_shutdown() {
+	if (running != 0 && coordinator_started)
+		shutdown_notify(SHUTDOWN_BEGIN);
+	else if (running != 0 && inline_mode && !closing)
+		shutdown_begin();
+}
+
+size_t actor_system_dropped() {
+	return dropped;
+}
+
+size_t actor_system_shed() {
+	return shed_count;
+}
+
+bool actor_system_running() {
+	return running != 0;
+}
+
+int actor_pool_workers() {
+	int live = 0;
+
+	if (running == 0 || thread_pool == NULL)
+		return 0;
+
+	if (pthread_mutex_lock(&(thread_pool->park_mutex)) != 0)
+		return -1;
+
+	live = thread_pool->live;
+
+	if (pthread_mutex_unlock(&(thread_pool->park_mutex)) != 0)
+		return -1;
+
+	return live;
+}
+
+int actor_pool_destroy() {
+	if (running != 0)
+		return -1;
+
+	if (thread_pool != NULL)
+		tp_stop();
+
+	return 0;
+}
+
+static int actor_system_start(actor_id_t* actor, role_t* const role, role_ctx_t* const ctx_role) {
+	if (!module_init_state())
+		return -1;
+
+	actor_t* a = actor_create(role, ctx_role);
+
+	if (a == NULL) {
+		module_destroy_state();
+		return -1;
+	}
+
+	tp_attach();
+
+	*actor = a->id;
+
+	// the first handler may already start something that delivers back to it
+	node_open = true;
+	send_message(a->id, msg_hello(NULL));
+
+	return 0;
+}
+
+int actor_system_create(actor_id_t* actor, role_t* const role) {
+	return actor_system_start(actor, role, NULL);
+}
+
+int actor_system_create_ctx(actor_id_t* actor, role_ctx_t* const role) {
+	return actor_system_start(actor, NULL, role);
+}
+
+
+#define SM_SUCCESS 0
+#define SM_ACTOR_DEAD -1
+#define SM_ACTOR_NEXISTS -2
+#define SM_ERROR -3
+
+static int worker_self() {
+	// thread_number only exists along with the pool
+	if (thread_pool == NULL)
+		return -1;
+
+	int* t_num_ptr = (int*)pthread_getspecific(thread_number);
+
+	if (t_num_ptr == NULL)
+		return -1;
+
+	return *t_num_ptr;
+}
+
+static actor_t* actor_current() {
+	int t_num = worker_self();
+
+	if (t_num < 0)
+		return NULL;
+
+	return thread_pool->current_actor[t_num];
+}
+
+static int sm_result(int ret) {
+	switch (ret) {
+		case ACTOR_SUCCESS:
+			return SM_SUCCESS;
+
+		case ACTOR_DEAD:
+			return SM_ACTOR_DEAD;
+
+		case ACTOR_ERROR:
+		case ACTOR_FULL:
+			return SM_ERROR;
+
+		default:
+			exit(-1);
 	}
+}
 
-	return TQ_SUCCESS;
+// node - actors of other processes, reached through a transport per node
+static actor_transport_t const* _Atomic transports[ACTOR_NODE_LIMIT];
+static _Atomic int node_self = -1;
+// sends that may hold a transport they found routed
+static _Atomic int node_sending;
+
+#define NODE_LOCAL_MASK (((actor_id_t)1 << ACTOR_NODE_SHIFT) - 1)
+
+actor_id_t actor_node_id(int node, actor_id_t actor) {
+	if (node < 0 || node >= ACTOR_NODE_LIMIT || actor < 0)
+		return ACTOR_ID_NONE;
+
+	return ((actor_id_t)(node + 1) << ACTOR_NODE_SHIFT) | (actor & NODE_LOCAL_MASK);
 }
 
-static int tq_pop(tq_t* q) {
-	if (tq_empty(q))
-		return TQ_EMPTY;
+int actor_node_of(actor_id_t actor) {
+	if (actor < 0)
+		return -1;
 
-	q->front = (q->front + 1) % q->max_len;
-	--(q->cur_len);
+	return (int)(actor >> ACTOR_NODE_SHIFT) - 1;
+}
 
-	if (q->cur_len < q->max_len / 4) {
-		actor_id_t* new_actors = (actor_id_t*)malloc(sizeof(actor_id_t) * q->max_len / 2);
-		if (new_actors == NULL) {
-			++(q->cur_len);
-			q->front = (q->max_len + q->front - 1) % q->max_len;
-			return TQ_BAD_ALLOC;
-		}
+int actor_node_self() {
+	return node_self;
+}
 
-		for (int i = 0; i < q->cur_len; ++i) {
-			new_actors[i] = q->actors[(q->front + i) % q->max_len];
-		}
+void actor_node_set_self(int node) {
+	node_self = node;
+}
 
-		free(q->actors);
-		q->actors = new_actors;
-		q->front = 0;
-		q->back = q->cur_len - 1;
-		q->max_len /= 2;
+int actor_node_route(int node, actor_transport_t const* transport) {
+	if (node < 0 || node >= ACTOR_NODE_LIMIT)
+		return SM_ERROR;
+
+	transports[node] = transport;
+	return SM_SUCCESS;
+}
+
+void actor_node_settle() {
+	while (node_sending > 0)
+		sched_yield();
+}
+
+// the plain id when the actor lives here, the global one otherwise
+static actor_id_t node_local(actor_id_t actor) {
+	int node = actor_node_of(actor);
+
+	if (node >= 0 && node == node_self)
+		return actor & NODE_LOCAL_MASK;
+
+	return actor;
+}
+
+static bool node_remote(actor_id_t actor) {
+	return actor_node_of(actor) >= 0;
+}
+
+static int node_send(actor_id_t actor, actor_t* sender, message_t message) {
+	// a role pointer means nothing in another process
+	if (message.message_type == MSG_SPAWN || message.message_type == MSG_SPAWN_CTX || closing)
+		return SM_ERROR;
+
+	int node = actor_node_of(actor);
+
+	// counted before the route is read, so actor_node_settle sees whoever found one
+	++node_sending;
+
+	actor_transport_t const* t = transports[node];
+
+	if (t == NULL) {
+		--node_sending;
+		return SM_ACTOR_NEXISTS;
 	}
 
-	return TQ_SUCCESS;
+	actor_id_t from = sender == NULL ? ACTOR_ID_NONE : actor_node_id(node_self, sender->id);
+	int ret = t->send(t->self, node, actor & NODE_LOCAL_MASK, from, message);
+
+	--node_sending;
+
+	return ret != 0 ? SM_ERROR : SM_SUCCESS;
 }
 
-static actor_id_t tq_front(tq_t* q) {
-	return q->actors[q->front];
+int actor_node_deliver(actor_id_t target, actor_id_t sender, message_type_t type, actor_buffer_t* buffer) {
+	++node_entering;
+
+	actor_t* a = node_open ? actor_get(node_local(target)) : NULL;
+
+	if (a == NULL) {
+		--node_entering;
+		return SM_ACTOR_NEXISTS;
+	}
+
+	envelope_t env;
+	env.msg.message_type = type;
+	env.msg.nbytes = buffer->nbytes;
+	env.msg.data = buffer->data;
+	env.sender = NULL;
+	env.origin = sender;
+	env.promise = NULL;
+	env.buffer = buffer_retain(buffer);
+	env.deadline = 0;
+
+	int ret = actor_send_env(a, env, worker_self());
+
+	if (ret != ACTOR_SUCCESS)
+		buffer_release(buffer);
+
+	--node_entering;
+
+	// the transport keeps the message and tries again; it delivers for others too,
+	// so it must not wait here
+	if (ret == ACTOR_FULL)
+		return ACTOR_NODE_FULL;
+
+	return sm_result(ret);
 }
 
-// tp - thread pool
-typedef struct thread_pool {
-	pthread_t* threads;
-	actor_t** current_actor;
-	void* keys;
-	tq_t* thread_queue;
-	pthread_mutex_t queue_mutex;
-	pthread_cond_t wait_on_q;
-} tp_t;
+unsigned actor_node_hold() {
+	if (pthread_mutex_lock(&hold_lock) != 0)
+		exit(-1);
 
-static tp_t* tp_init() {
-	tp_t* tp = (tp_t*)malloc(sizeof(tp_t));
-	tp->threads = (pthread_t*)malloc(sizeof(pthread_t) * POOL_SIZE);
+	unsigned token = 0;
 
-	if (tp->threads == NULL)
-		return NULL;
+	if (running != 0 && !closing && system_config.termination == ACTOR_TERMINATE_QUIESCENT) {
+		++in_flight;
+		++pending_holds;
+		token = hold_epoch;
+	}
 
-	tp->current_actor = (actor_t**)malloc(sizeof(actor_t*) * POOL_SIZE);
+	if (pthread_mutex_unlock(&hold_lock) != 0)
+		exit(-1);
 
-	if (tp->current_actor == NULL) {
-		free(tp->threads);
-		return NULL;
+	return token;
+}
+
+void actor_node_release(unsigned token) {
+	if (token == 0)
+		return;
+
+	if (pthread_mutex_lock(&hold_lock) != 0)
+		exit(-1);
+
+	bool held = token == hold_epoch;
+
+	if (held)
+		--pending_holds;
+
+	if (pthread_mutex_unlock(&hold_lock) != 0)
+		exit(-1);
+
+	if (held)
+		tp_message_done(1);
+}
+
+int send_message(actor_id_t actor, message_t message) {
+	int worker = worker_self();
+	actor_t* sender = worker < 0 ? NULL : thread_pool->current_actor[worker];
+
+	if (node_remote(actor = node_local(actor)))
+		return node_send(actor, sender, message);
+
+	actor_t* a = sender != NULL && sender->id == actor ? sender : actor_get(actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	return sm_result(actor_send_msg(a, message, sender, worker));
+}
+
+// a deadline does not cross to another node, where the clock is not the same
+int send_message_within(actor_id_t actor, message_t message, long timeout_ms) {
+	int worker = worker_self();
+	actor_t* sender = worker < 0 ? NULL : thread_pool->current_actor[worker];
+
+	if (node_remote(actor = node_local(actor)))
+		return node_send(actor, sender, message);
+
+	actor_t* a = sender != NULL && sender->id == actor ? sender : actor_get(actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	return sm_result(actor_send_until(a, message, sender, worker, clock_ns() + timeout_ms * 1000000LL));
+}
+
+int send_buffer(actor_id_t actor, message_type_t type, actor_buffer_t* buffer) {
+	int worker = worker_self();
+	actor_t* sender = worker < 0 ? NULL : thread_pool->current_actor[worker];
+
+	// the transport copies the data out
+	if (node_remote(actor = node_local(actor))) {
+		message_t message = {type, buffer->nbytes, buffer->data};
+		return node_send(actor, sender, message);
 	}
 
-	tp->keys = malloc(sizeof(int) * POOL_SIZE);
+	actor_t* a = sender != NULL && sender->id == actor ? sender : actor_get(actor);
 
-	if (tp->keys == NULL) {
-		free(tp->current_actor);
-		free(tp->threads);
-		return NULL;
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	envelope_t env;
+	env.msg.message_type = type;
+	env.msg.nbytes = buffer->nbytes;
+	env.msg.data = buffer->data;
+	env.sender = sender;
+	env.origin = ACTOR_ID_NONE;
+	env.promise = NULL;
+	env.buffer = buffer_retain(buffer);
+	env.deadline = 0;
+
+	int ret = a == sender && worker >= 0 ? actor_send_self(a, env, worker) : actor_send_env(a, env, worker);
+
+	if (ret != ACTOR_SUCCESS)
+		buffer_release(buffer);
+
+	return sm_result(ret);
+}
+
+int actor_group_create(actor_id_t* group, role_ctx_t* const role, actor_group_config_t const* cfg) {
+	if (running == 0 || closing || cfg->members == 0 || cfg->routing < ACTOR_GROUP_BALANCE
+			|| cfg->routing > ACTOR_GROUP_HASH || (cfg->routing == ACTOR_GROUP_HASH && cfg->key == NULL))
+		return SM_ERROR;
+
+	group_t* grp = (group_t*)malloc(sizeof(group_t));
+	if (grp == NULL)
+		return SM_ERROR;
+
+	grp->member = (actor_t**)malloc(sizeof(actor_t*) * cfg->members);
+	if (grp->member == NULL) {
+		free(grp);
+		return SM_ERROR;
 	}
 
-	int* keys = (int*)tp->keys;
+	grp->idle = (actor_t**)malloc(sizeof(actor_t*) * cfg->members);
+	if (grp->idle == NULL) {
+		free(grp->member);
+		free(grp);
+		return SM_ERROR;
+	}
 
-	for (int i = 0; i < POOL_SIZE; ++i) {
-		keys[i] = i;
+	grp->routing = cfg->routing;
+	grp->members = cfg->members;
+	grp->key = cfg->key;
+	grp->next = 0;
+	grp->nidle = 0;
+
+	actor_t* g = actor_init();
+	if (g == NULL) {
+		free(grp->idle);
+		free(grp->member);
+		free(grp);
+		return SM_ERROR;
 	}
 
-	if (pthread_mutex_init(&(tp->queue_mutex), NULL) != 0) {
-		free(tp->keys);
-		free(tp->current_actor);
-		free(tp->threads);
-		return NULL;
+	g->role = NULL;
+	g->ctx_role = NULL;
+	g->group = grp;
+
+	// records carved for a group that does not fit stay unused until the system ends
+	for (size_t i = 0; i < cfg->members; ++i) {
+		grp->member[i] = actor_init();
+
+		if (grp->member[i] == NULL) {
+			free(grp->idle);
+			free(grp->member);
+			free(grp);
+			return SM_ERROR;
+		}
+
+		grp->member[i]->role = NULL;
+		grp->member[i]->ctx_role = role;
+		grp->member[i]->pool = cfg->routing == ACTOR_GROUP_BALANCE ? g : NULL;
 	}
 
-	if (pthread_cond_init(&(tp->wait_on_q), NULL) != 0) {
-		pthread_mutex_destroy(&(tp->queue_mutex));
-		free(tp->keys);
-		free(tp->current_actor);
-		free(tp->threads);
-		return NULL;
+	for (size_t i = 0; i < cfg->members; ++i) {
+		if (actor_register(grp->member[i]) == NULL)
+			exit(-1);
 	}
 
-	if ((tp->thread_queue = tq_init()) == NULL) {
-		pthread_cond_destroy(&(tp->wait_on_q));
-		pthread_mutex_destroy(&(tp->queue_mutex));
-		free(tp->keys);
-		free(tp->current_actor);
-		free(tp->threads);
-		return NULL;
+	if (actor_register(g) == NULL)
+		exit(-1);
+
+	int worker = worker_self();
+	actor_t* creator = worker < 0 ? NULL : thread_pool->current_actor[worker];
+
+	for (size_t i = 0; i < cfg->members; ++i) {
+		int ret = actor_send_msg(grp->member[i], msg_hello(creator), creator, worker);
+		if (ret == ACTOR_ERROR || ret == ACTOR_FULL)
+			return SM_ERROR;
 	}
 
-	return tp;
+	*group = g->id;
+	return SM_SUCCESS;
 }
 
-static void tp_destroy(tp_t** tp) {
-	tq_destroy(&((*tp)->thread_queue));
-	pthread_cond_destroy(&((*tp)->wait_on_q));
-	pthread_mutex_destroy(&((*tp)->queue_mutex));
-	free((*tp)->current_actor);
-	free((*tp)->keys);
-	free((*tp)->threads);
-	free(*tp);
+int actor_suspendable(actor_id_t actor) {
+	actor_t* a = node_remote(actor) ? NULL : actor_get(actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	if (a->group != NULL) {
+		for (size_t i = 0; i < a->group->members; ++i) {
+			if (a->group->member[i]->reentrant)
+				return SM_ERROR;
+		}
+
+		for (size_t i = 0; i < a->group->members; ++i)
+			a->group->member[i]->suspendable = true;
+	}
+	else if (a->reentrant) {
+		return SM_ERROR;
+	}
+	else {
+		a->suspendable = true;
+	}
+
+	return SM_SUCCESS;
 }
 
-// Module state
-static _Atomic int running = 0;
-static bool sigint_set = false;
-static bool killed;
-static tp_t* thread_pool;
+// a suspended handler holds its actor's only coroutine, and balancing members
+// already share one mailbox
+int actor_shed(actor_id_t actor, size_t depth, act_ctx_t expired) {
+	actor_t* a = node_remote(actor) ? NULL : actor_get(actor);
 
-static int tp_notify(actor_id_t a) {
-	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
-		return -1;
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-	int ret = tq_push(thread_pool->thread_queue, a);
+	size_t n = a->group != NULL ? a->group->members : 1;
 
-	if (ret != TQ_SUCCESS) {
-		return -1;
+	for (size_t i = 0; i < n; ++i) {
+		actor_t* m = a->group != NULL ? a->group->member[i] : a;
+		shed_t* shed = (shed_t*)malloc(sizeof(shed_t));
+
+		if (shed == NULL)
+			return SM_ERROR;
+
+		shed->depth = depth;
+		shed->expired = expired;
+
+		actor_lock(m);
+		shed->replaced = m->shed;
+		m->shed = shed;
+		actor_unlock(m);
 	}
 
-	if (pthread_cond_signal(&(thread_pool->wait_on_q)) != 0)
+	return SM_SUCCESS;
+}
+
+int actor_batch_prompt(role_ctx_t const* role, message_type_t type, act_batch_t prompt, size_t max) {
+	if (running != 0 || role == NULL || prompt == NULL || max == 0 || max > ACTOR_BATCH_MAX
+			|| type <= MSG_HELLO || (size_t)type >= role->nprompts)
 		return -1;
 
-	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+	for (size_t i = 0; i < nbatches; ++i) {
+		if (batches[i].role == role && batches[i].type == type) {
+			batches[i].prompt = prompt;
+			batches[i].max = max;
+			return 0;
+		}
+	}
+
+	if (nbatches == ACTOR_BATCH_PROMPTS)
 		return -1;
 
-	return 0;
+	batches[nbatches].role = role;
+	batches[nbatches].type = type;
+	batches[nbatches].prompt = prompt;
+	batches[nbatches].max = max;
+	++nbatches;
+	return 0;
+}
+
+int actor_reentrant(actor_id_t actor) {
+	actor_t* a = node_remote(actor) ? NULL : actor_get(actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	if (a->group != NULL) {
+		if (a->group->routing == ACTOR_GROUP_BALANCE)
+			return SM_ERROR;
+
+		for (size_t i = 0; i < a->group->members; ++i) {
+			if (a->group->member[i]->suspendable)
+				return SM_ERROR;
+		}
+
+		for (size_t i = 0; i < a->group->members; ++i)
+			a->group->member[i]->reentrant = true;
+	}
+	else if (a->suspendable) {
+		return SM_ERROR;
+	}
+	else {
+		a->reentrant = true;
+	}
+
+	return SM_SUCCESS;
+}
+
+int actor_weight(actor_id_t actor, unsigned weight) {
+	actor_t* a = node_remote(actor) ? NULL : actor_get(actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	if (a->group != NULL) {
+		for (size_t i = 0; i < a->group->members; ++i)
+			actor_weigh(a->group->member[i], weight);
+	}
+	else {
+		actor_weigh(a, weight);
+	}
+
+	return SM_SUCCESS;
+}
+
+actor_id_t actor_id_self() {
+	actor_t* a = actor_current();
+
+	if (a == NULL)
+		exit(-1);
+
+	return a->id;
+}
+
+static actor_t* ctx_target(actor_ctx_t* ctx, actor_id_t actor) {
+	if (actor == ctx->self)
+		return (actor_t*)ctx->self_handle;
+	else if (actor == ctx->sender)
+		return (actor_t*)ctx->sender_handle;
+	else
+		return actor_get(actor);
+}
+
+int ctx_send(actor_ctx_t* ctx, actor_id_t actor, message_t message) {
+	if (node_remote(actor = node_local(actor)))
+		return node_send(actor, (actor_t*)ctx->self_handle, message);
+
+	actor_t* a = ctx_target(ctx, actor);
+
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
+
+	return sm_result(actor_send_msg(a, message, (actor_t*)ctx->self_handle, ctx->worker));
 }
 
-static pthread_mutex_t join_mutex;
-static pthread_cond_t waiting_to_endoperating;
-static pthread_cond_t waiting_to_enddestroying;
-static bool finished_operating;
-static int joining;
-static bool finished_destroying;
-static int toexit;
+int ctx_send_within(actor_ctx_t* ctx, actor_id_t actor, message_t message, long timeout_ms) {
+	if (node_remote(actor = node_local(actor)))
+		return node_send(actor, (actor_t*)ctx->self_handle, message);
 
-static _Atomic int threads_finished;
+	actor_t* a = ctx_target(ctx, actor);
 
-static _Atomic int destroyed;
-static bool registered_finished_operating;
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-static void reset_sigint() {
-	struct sigaction sigint_action;
-	sigint_action.sa_handler = SIG_DFL;
-	sigint_action.sa_flags = SA_NODEFER;
-	sigaction(SIGINT, &sigint_action, NULL);
+	long long deadline = clock_ns() + timeout_ms * 1000000LL;
+	return sm_result(actor_send_until(a, message, (actor_t*)ctx->self_handle, ctx->worker, deadline));
 }
 
-static void module_destroy_state() {
-	reset_sigint();
-	pthread_cond_destroy(&waiting_to_endoperating);
-	pthread_mutex_destroy(&state_counters_lock);
-	pthread_key_delete(thread_number);
-	tp_destroy(&thread_pool);
+int ctx_forward(actor_ctx_t* ctx, actor_id_t actor, message_t message) {
+	// a pending ask cannot follow the message to another process
+	if (node_remote(actor = node_local(actor)))
+		return ctx->reply_handle != NULL ? SM_ERROR : node_send(actor, (actor_t*)ctx->self_handle, message);
 
-	for (int i = 0; i < CAST_LIMIT; ++i) {
-		if (actors[i] != NULL) {
-			actor_destroy(&(actors[i]));
-		}
-			
-	}
-}
+	actor_t* a = ctx_target(ctx, actor);
 
-static void tp_join() {
-	if (pthread_mutex_lock(&join_mutex) != 0)
-		exit(-1);
-	++toexit;
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-	if (!registered_finished_operating) {
-		++joining;
-		while (!finished_operating) {
-			if (pthread_cond_wait(&waiting_to_endoperating, &join_mutex) != 0)
-				exit(-1);
-		}
-		registered_finished_operating = true;
-		--joining;
-		if (joining == 0) {
-			if (pthread_mutex_unlock(&join_mutex) != 0)
-				exit(-1);
+	envelope_t env;
+	env.msg = message;
+	env.sender = (actor_t*)ctx->self_handle;
+	env.origin = ACTOR_ID_NONE;
+	env.promise = (promise_t*)ctx->reply_handle;
+	env.buffer = NULL;
+	env.deadline = 0;
 
-			module_destroy_state();
+	int ret = a == env.sender ? actor_send_self(a, env, ctx->worker) : actor_send_env(a, env, ctx->worker);
 
-			if (pthread_mutex_lock(&join_mutex) != 0)
-				exit(-1);
+	// the reply slot moves with the message; on failure it is broken as unanswered
+	if (ret == ACTOR_SUCCESS)
+		ctx->reply_handle = NULL;
 
-			finished_destroying = true;
-			if (pthread_cond_broadcast(&waiting_to_enddestroying) != 0)
-				exit(-1);
-		}
-	}
-	while (!finished_destroying) {
-		if (pthread_cond_wait(&waiting_to_enddestroying, &join_mutex) != 0)
-				exit(-1);
+	return sm_result(ret);
+}
+
+int ctx_reply(actor_ctx_t* ctx, message_t message) {
+	if (ctx->reply_handle != NULL) {
+		promise_settle((promise_t*)ctx->reply_handle, PROMISE_READY, message);
+		ctx->reply_handle = NULL;
+		return SM_SUCCESS;
 	}
 
-	--toexit;
+	actor_t* a = (actor_t*)ctx->sender_handle;
 
-	if (pthread_mutex_unlock(&join_mutex) != 0)
-		exit(-1);
-	
-	if (toexit == 0 && destroyed++ == 0) {
-		pthread_cond_destroy(&waiting_to_enddestroying);
-		pthread_mutex_destroy(&join_mutex);
-		count_actors = 0;
-		running = 0;
-	}
-}
+	if (a == NULL && node_remote(ctx->sender))
+		return node_send(ctx->sender, (actor_t*)ctx->self_handle, message);
 
-static void stop_tp(int signo) {
-	if (signo == SIGINT) {
-		killed = true;
-		pthread_cond_broadcast(&(thread_pool->wait_on_q));
-		for (int i = 0; i < CAST_LIMIT; i++) {
-			if (actors[i] != NULL) {
-				for (int j = 0; j < POOL_SIZE; j++) {
-					pthread_cond_broadcast(&(actors[i]->wait_for_msg[j]));
-				}
-			}
-		}
-	}
-		
-	else
-		exit(-1);
-	
-	//tp_join();
-}
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-static void set_sigint() {
-	struct sigaction sigint_action;
-	sigint_action.sa_handler = stop_tp;
-	sigint_action.sa_flags = SA_RESTART | SA_RESETHAND;
-	sigaction(SIGINT, &sigint_action, NULL);
-	sigint_set = true;
+	return sm_result(actor_send_msg(a, message, (actor_t*)ctx->self_handle, ctx->worker));
 }
 
-static bool module_init_state() {
-	if (running++ != 0)
-		return false;
-	
-	killed = false;
-	finished_operating = false;
-	joining = 0;
-	finished_destroying = false;
-	toexit = 0;
-	count_actors = 0;
-	actors_finished = 0;
-	threads_finished = 0;
-	destroyed = 0;
-	registered_finished_operating = false;
+int ask(actor_id_t actor, message_t message, future_t* future) {
+	future->promise = NULL;
 
-	if (!sigint_set) {
-		set_sigint();
-		sigint_set = true;
-	}
+	// replies do not come back from other processes
+	if (node_remote(actor = node_local(actor)))
+		return SM_ERROR;
 
-	if ((thread_pool = tp_init()) == NULL)
-		return false;
+	actor_t* a = actor_get(actor);
 
-	if (pthread_key_create(&thread_number, NULL) != 0) {
-		tp_destroy(&thread_pool);
-		return false;
-	}
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-	if (pthread_mutex_init(&state_counters_lock, NULL) != 0) {
-		pthread_key_delete(thread_number);
-		tp_destroy(&thread_pool);
-		return false;
-	}
+	promise_t* p = promise_create();
+	if (p == NULL)
+		return SM_ERROR;
 
-	if (pthread_mutex_init(&join_mutex, NULL) != 0) {
-		pthread_mutex_destroy(&state_counters_lock);
-		pthread_key_delete(thread_number);
-		tp_destroy(&thread_pool);
-		return false;
-	}
+	int worker = worker_self();
 
-	if (pthread_cond_init(&waiting_to_endoperating, NULL) != 0) {
-		pthread_mutex_destroy(&join_mutex);
-		pthread_mutex_destroy(&state_counters_lock);
-		pthread_key_delete(thread_number);
-		tp_destroy(&thread_pool);
-		return false;
-	}
+	envelope_t env;
+	env.msg = message;
+	env.sender = worker < 0 ? NULL : thread_pool->current_actor[worker];
+	env.origin = ACTOR_ID_NONE;
+	env.promise = p;
+	env.buffer = NULL;
+	env.deadline = 0;
 
-	if (pthread_cond_init(&waiting_to_enddestroying, NULL) != 0) {
-		pthread_cond_destroy(&waiting_to_endoperating);
-		pthread_mutex_destroy(&join_mutex);
-		pthread_mutex_destroy(&state_counters_lock);
-		pthread_key_delete(thread_number);
-		tp_destroy(&thread_pool);
-		return false;
+	int ret = actor_send_env(a, env, worker);
+
+	if (ret != ACTOR_SUCCESS) {
+		promise_release(p);
+		promise_release(p);
+		return sm_result(ret);
 	}
 
-	return true;
+	future->promise = p;
+	return SM_SUCCESS;
 }
 
+// the running coroutine of the ctx's actor, NULL outside a suspendable handler
+static coro_t* ctx_coro(actor_ctx_t* ctx) {
+	actor_t* a = (actor_t*)ctx->self_handle;
 
-// Threads
-static void* thread_running(void* t_number) {
-	if (pthread_setspecific(thread_number, t_number) != 0)
-		exit(-1);
+	if (a == NULL || a->coro == NULL || &(a->coro->actx) != ctx)
+		return NULL;
 
-	size_t t_num = (size_t)(*((int*)t_number));
+	return a->coro;
+}
 
-	while (actors_finished < count_actors) {
-		if (killed)
-			break;
+static int future_result(promise_t* p, message_t* reply);
 
+int ctx_await(actor_ctx_t* ctx, actor_id_t actor, message_t message, message_t* reply) {
+	coro_t* co = ctx_coro(ctx);
 
-		if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
-			exit(-1);
+	if (co == NULL || node_remote(actor = node_local(actor)))
+		return SM_ERROR;
 
-		while (tq_empty(thread_pool->thread_queue)) {
-			if (killed) {
-				if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
-					exit(-1);
-				break;
-			}
+	actor_t* a = ctx_target(ctx, actor);
 
-			if (pthread_cond_wait(&(thread_pool->wait_on_q), &(thread_pool->queue_mutex)) != 0)
-				exit(-1);
-			
-			if (killed) {
-				if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
-					exit(-1);
-				break;
-			}
-		}
+	if (a == NULL)
+		return SM_ACTOR_NEXISTS;
 
-		if (killed) {
-			if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
-				exit(-1);
-			break;
-		}
-		
-		actor_id_t id_a = tq_front(thread_pool->thread_queue);
-		tq_pop(thread_pool->thread_queue);
-		actor_t* a = actor_get(id_a);
+	// the actor only reads its mailbox after this handler, so it cannot answer itself
+	if (a == (actor_t*)ctx->self_handle)
+		return SM_ERROR;
 
-		if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
-			exit(-1);
+	promise_t* p = promise_create();
+	if (p == NULL)
+		return SM_ERROR;
 
+	envelope_t env;
+	env.msg = message;
+	env.sender = (actor_t*)ctx->self_handle;
+	env.origin = ACTOR_ID_NONE;
+	env.promise = p;
+	env.buffer = NULL;
+	env.deadline = 0;
 
-		if (pthread_mutex_lock(&(a->lock_thread)) != 0)
-			exit(-1);
+	int ret = actor_send_env(a, env, ctx->worker);
 
-		while (a->active) {
-			int to_wait = a->to_wait;
-			a->to_wait = (a->to_wait + 1) % POOL_SIZE;
-			a->waiting = a->waiting + 1;
+	if (ret != ACTOR_SUCCESS) {
+		promise_release(p);
+		promise_release(p);
+		return sm_result(ret);
+	}
 
-			if (killed) {
-				if (pthread_mutex_unlock(&(a->lock_thread)) != 0)
-					exit(-1);
-				break;
-			}
+	coro_suspend(co, p);
 
-			if (pthread_cond_wait(&(a->wait_for_msg[to_wait]), &(a->lock_thread)) != 0)
-				exit(-1);
-			
-			if (killed) {
-				if (pthread_mutex_unlock(&(a->lock_thread)) != 0)
-					exit(-1);
-				break;
-			}
-		}
+	ret = future_result(p, reply);
+	promise_release(p);
+	return ret;
+}
 
-		if (killed) {
-			if (pthread_mutex_unlock(&(a->lock_thread)) != 0)
-				exit(-1);
-			break;
-		}
-		
-		a->active = true;
-		
-		if (pthread_mutex_unlock(&(a->lock_thread)) != 0)
-			exit(-1);
+int ctx_sleep(actor_ctx_t* ctx, long ms) {
+	coro_t* co = ctx_coro(ctx);
 
+	if (co == NULL)
+		return SM_ERROR;
 
-		thread_pool->current_actor[t_num] = a;
+	promise_t* p = promise_create();
+	if (p == NULL)
+		return SM_ERROR;
 
-		int check = actor_exec(a);
+	if (sleep_add(p, ms > 0 ? ms : 0) != 0) {
+		promise_release(p);
+		promise_release(p);
+		return SM_ERROR;
+	}
 
-		if (check == ACTOR_ERROR)
-			exit(-1);
+	coro_suspend(co, p);
 
+	promise_release(p);
+	return SM_SUCCESS;
+}
 
-		if (pthread_mutex_lock(&(a->lock_thread)) != 0)
-			exit(-1);
-		
-		a->active = false;
+static int future_result(promise_t* p, message_t* reply) {
+	if (p->state == PROMISE_BROKEN)
+		return FUTURE_BROKEN;
 
-		if (a->waiting > 0) {
-			int to_signal = a->to_signal;
-			a->to_signal = (a->to_signal + 1) % POOL_SIZE;
-			a->waiting = a->waiting - 1;
+	if (reply != NULL)
+		*reply = p->reply;
 
-			if (pthread_cond_signal(&(a->wait_for_msg[to_signal])) != 0)
-				exit(-1);
-		}
+	return FUTURE_SUCCESS;
+}
 
-		if (pthread_mutex_unlock(&(a->lock_thread)) != 0)
-			exit(-1);
+// waits up to timeout_ms for p to settle, returns false on timeout
+static bool future_timedwait(promise_t* p, long timeout_ms) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_nsec -= 1000000000;
+		++deadline.tv_sec;
 	}
 
-	killed = true;
-
-
-	if (pthread_mutex_lock(&(thread_pool->queue_mutex)) != 0)
+	if (pthread_mutex_lock(&(p->lock)) != 0)
 		exit(-1);
 
-	if (pthread_cond_broadcast(&(thread_pool->wait_on_q)) != 0)
-		exit(-1);
+	while (p->state == PROMISE_PENDING) {
+		int ret = pthread_cond_timedwait(&(p->ready), &(p->lock), &deadline);
+		if (ret == ETIMEDOUT)
+			break;
+		if (ret != 0)
+			exit(-1);
+	}
 
-	if (pthread_mutex_unlock(&(thread_pool->queue_mutex)) != 0)
+	if (pthread_mutex_unlock(&(p->lock)) != 0)
 		exit(-1);
 
+	return p->state != PROMISE_PENDING;
+}
 
-	if (++threads_finished >= POOL_SIZE) {
-		int ret;
-
-		for (int i = 0; i < POOL_SIZE; ++i) {
-			if ((size_t)i != t_num && pthread_join(thread_pool->threads[i], (void **)(&ret)) == 35)
-				exit(-1);
-		}
+// an inline system only moves while someone runs it, so a caller outside of it
+// lends its thread whenever nobody else does
+static bool future_pumps() {
+	return inline_mode && running != 0 && worker_self() < 0;
+}
 
-		if (pthread_mutex_lock(&join_mutex) != 0)
-			exit(-1);
-		
-		finished_operating = true;
-		if (pthread_cond_broadcast(&waiting_to_endoperating) != 0)
-			exit(-1);
+static void future_pump(promise_t* p) {
+	if (!inline_enter())
+		return;
 
-		if (pthread_mutex_unlock(&join_mutex) != 0)
-			exit(-1);
-	}
+	while (p->state == PROMISE_PENDING && inline_step());
 
-	return 0;
+	inline_leave();
 }
 
+// wait in short slices, running the inline system in between
+static int future_wait_inline(promise_t* p, message_t* reply, long timeout_ms) {
+	while (true) {
+		future_pump(p);
 
-// Interface
-void actor_system_join(actor_id_t actor) {
-	actor_t* a = actor_get(actor);
-	if (a == NULL)
-		exit(-1);
+		if (p->state != PROMISE_PENDING)
+			break;
 
-	tp_join();
-}
+		if (timeout_ms == 0)
+			return FUTURE_TIMEOUT;
 
-int actor_system_create(actor_id_t* actor, role_t* const role) {
-	if (!module_init_state())
-		return -1;
+		long slice = timeout_ms > 0 && timeout_ms < INLINE_SLICE_MS ? timeout_ms : INLINE_SLICE_MS;
 
-	actor_t* a = actor_create(role);
+		if (future_timedwait(p, slice))
+			break;
 
-	if (a == NULL) {
-		module_destroy_state();
-		return -1;
-	}
-	
-	for (int i = 0; i < POOL_SIZE; ++i) {
-		if (pthread_create(&(thread_pool->threads[i]),
-						NULL,
-						thread_running,
-						(void*)&(((int*)(thread_pool->keys))[i])) != 0) {
-			exit(-1);
-		}
+		if (timeout_ms > 0)
+			timeout_ms -= slice;
 	}
 
-	*actor = a->id;
+	return future_result(p, reply);
+}
 
-	send_message(a->id, msg_hello(NULL));
+// a handler about to block hands on the actor its worker would run next, which
+// may well be the one it waits for
+static void future_block() {
+	int worker = worker_self();
 
-	return 0;
+	if (worker < 0 || thread_pool->run_next[worker] == NULL)
+		return;
+
+	actor_t* next = thread_pool->run_next[worker];
+	thread_pool->run_next[worker] = NULL;
+
+	if (tp_notify(next) != 0)
+		exit(-1);
 }
 
+int future_wait(future_t* future, message_t* reply) {
+	promise_t* p = (promise_t*)future->promise;
 
-#define SM_SUCCESS 0
-#define SM_ACTOR_DEAD -1
-#define SM_ACTOR_NEXISTS -2
-#define SM_ERROR -3
+	if (p == NULL)
+		return FUTURE_BROKEN;
 
-int send_message(actor_id_t actor, message_t message) {
-	actor_t* a = actor_get(actor);
+	if (future_pumps())
+		return future_wait_inline(p, reply, -1);
 
-	if (a == NULL)
-		return SM_ACTOR_NEXISTS;
+	future_block();
 
-	int ret = actor_send_msg(a, message);
-	
-	switch (ret) {
-		case ACTOR_SUCCESS:
-			return SM_SUCCESS;
+	for (int i = 0; i < FUTURE_SPIN && p->state == PROMISE_PENDING; ++i);
 
-		case ACTOR_DEAD:
-			return SM_ACTOR_DEAD;
+	if (p->state == PROMISE_PENDING) {
+		if (pthread_mutex_lock(&(p->lock)) != 0)
+			return FUTURE_BROKEN;
 
-		case ACTOR_ERROR:
-			return SM_ERROR;
+		while (p->state == PROMISE_PENDING) {
+			if (pthread_cond_wait(&(p->ready), &(p->lock)) != 0)
+				exit(-1);
+		}
 
-		default:
-			exit(-1);
+		if (pthread_mutex_unlock(&(p->lock)) != 0)
+			return FUTURE_BROKEN;
 	}
+
+	return future_result(p, reply);
 }
 
-actor_id_t actor_id_self() {
-	int* t_num_ptr = (int*)pthread_getspecific(thread_number);
+int future_wait_for(future_t* future, message_t* reply, long timeout_ms) {
+	promise_t* p = (promise_t*)future->promise;
 
-	if (t_num_ptr == NULL)
-		exit(-1);
+	if (p == NULL)
+		return FUTURE_BROKEN;
 
-	actor_t* a = thread_pool->current_actor[*t_num_ptr];
-	return a->id;
+	if (future_pumps())
+		return future_wait_inline(p, reply, timeout_ms > 0 ? timeout_ms : 0);
+
+	future_block();
+
+	for (int i = 0; i < FUTURE_SPIN && p->state == PROMISE_PENDING; ++i);
+
+	if (p->state == PROMISE_PENDING && !future_timedwait(p, timeout_ms))
+		return FUTURE_TIMEOUT;
+
+	return future_result(p, reply);
+}
+
+void future_destroy(future_t* future) {
+	if (future->promise != NULL) {
+		promise_release((promise_t*)future->promise);
+		future->promise = NULL;
+	}
 }
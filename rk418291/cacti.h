@@ -2,6 +2,7 @@
 #define CACTI_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <signal.h>
@@ -10,6 +11,7 @@
 typedef long message_type_t;
 
 #define MSG_SPAWN (message_type_t)0x06057a6e
+#define MSG_SPAWN_CTX (message_type_t)0x06057a6c
 #define MSG_GODIE (message_type_t)0x60bedead
 #define MSG_HELLO (message_type_t)0x0
 
@@ -25,6 +27,18 @@ typedef long message_type_t;
 #define POOL_SIZE 3
 #endif
 
+#ifndef IDLE_RETIRE_MS
+#define IDLE_RETIRE_MS 1000
+#endif
+
+#ifndef ACTOR_BATCH_MAX
+#define ACTOR_BATCH_MAX 64
+#endif
+
+#ifndef ACTOR_BATCH_PROMPTS
+#define ACTOR_BATCH_PROMPTS 16
+#endif
+
 typedef struct message
 {
     message_type_t message_type;
@@ -34,6 +48,8 @@ typedef struct message
 
 typedef long actor_id_t;
 
+#define ACTOR_ID_NONE (actor_id_t)-1
+
 actor_id_t actor_id_self();
 
 typedef void (*const act_t)(void **stateptr, size_t nbytes, void *data);
@@ -44,10 +60,198 @@ typedef struct role
     act_t *prompts;
 } role_t;
 
+// Context passed to the prompts of role_ctx_t actors; valid only during the call.
+typedef struct actor_ctx
+{
+    actor_id_t self;
+    actor_id_t sender;
+    int worker;
+    void *self_handle;
+    void *sender_handle;
+    void *reply_handle;
+} actor_ctx_t;
+
+typedef void (*const act_ctx_t)(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+
+typedef struct role_ctx
+{
+    size_t nprompts;
+    act_ctx_t *prompts;
+} role_ctx_t;
+
+// Gets count messages of one type, oldest first, in place of that many calls of the
+// type's prompt; senders[i] sent messages[i], and the ctx is that of the first one.
+typedef void (*const act_batch_t)(actor_ctx_t *ctx, void **stateptr, size_t count, message_t const *messages,
+                                  actor_id_t const *senders);
+
+#define ACTOR_TERMINATE_GODIE 0
+#define ACTOR_TERMINATE_QUIESCENT 1
+
+#define ACTOR_EXECUTOR_POOL 0
+// No worker threads: the system runs on the thread in actor_system_join, or in
+// future_wait while that caller waits. SIGINT and drain_deadline_ms are not watched.
+#define ACTOR_EXECUTOR_INLINE 1
+// Inline when the pool would have a single worker, a pool otherwise.
+#define ACTOR_EXECUTOR_AUTO 2
+
+// Settings picked up by the next actor_system_create; all zeroes are the defaults.
+typedef struct actor_config
+{
+    int termination;
+    long drain_deadline_ms;
+    bool warm_pool;
+    int min_workers;
+    int max_workers;
+    // how long a worker above min_workers waits idle before it retires, 0 for
+    // IDLE_RETIRE_MS; a negative value keeps every worker once spawned
+    long idle_retire_ms;
+    int executor;
+} actor_config_t;
+
+void actor_config_default(actor_config_t *config);
+
+int actor_system_configure(actor_config_t const *config);
+
+// The settings the next actor_system_create will use.
+void actor_config_get(actor_config_t *config);
+
 int actor_system_create(actor_id_t *actor, role_t *const role);
 
+int actor_system_create_ctx(actor_id_t *actor, role_ctx_t *const role);
+
 void actor_system_join(actor_id_t actor);
 
+// Whether a system is running, so a helper can put its work there instead of
+// creating a system of its own.
+bool actor_system_running();
+
 int send_message(actor_id_t actor, message_t message);
 
+// Like send_message, but the message is shed instead of handled if it still waits
+// timeout_ms milliseconds from now, so a negative one is always shed. The deadline
+// is lost on the way to another node.
+int send_message_within(actor_id_t actor, message_t message, long timeout_ms);
+
+// A refcounted block that may not change once sent; the creator holds one reference.
+typedef struct actor_buffer actor_buffer_t;
+
+actor_buffer_t *buffer_create(size_t nbytes);
+
+void *buffer_data(actor_buffer_t *buffer);
+
+size_t buffer_size(actor_buffer_t const *buffer);
+
+// The buffer a handler's data points into, when the message came from send_buffer.
+actor_buffer_t *buffer_of(void const *data);
+
+actor_buffer_t *buffer_retain(actor_buffer_t *buffer);
+
+void buffer_release(actor_buffer_t *buffer);
+
+// Delivers the buffer's data without copying it. The delivery holds a reference
+// until its handler returns; to keep or pass on the data, retain or send buffer_of(data).
+int send_buffer(actor_id_t actor, message_type_t type, actor_buffer_t *buffer);
+
+// Same as SIGINT: stop accepting sends and spawns, drain, then end the system.
+void actor_system_shutdown();
+
+size_t actor_system_dropped();
+
+// Messages shed for their deadline or by actor_shed since the system was created.
+size_t actor_system_shed();
+
+int actor_pool_workers();
+
+// Ends the workers a warm_pool system left parked.
+int actor_pool_destroy();
+
+// How much worker time an actor gets while others wait for it too, relative to
+// theirs: a weight 4 actor handles about 4 messages for each one of a weight 1
+// actor. On a group id it sets the weight of every member.
+#define ACTOR_WEIGHT_DEFAULT 1
+#define ACTOR_WEIGHT_MAX 1024
+
+int actor_weight(actor_id_t actor, unsigned weight);
+
+int ctx_send(actor_ctx_t *ctx, actor_id_t actor, message_t message);
+
+int ctx_send_within(actor_ctx_t *ctx, actor_id_t actor, message_t message, long timeout_ms);
+
+int ctx_reply(actor_ctx_t *ctx, message_t message);
+
+// Like ctx_send, but the message takes over the pending ask, so whoever handles it
+// answers with ctx_reply. Forwarding a spawn hands the ask to the new actor's hello.
+int ctx_forward(actor_ctx_t *ctx, actor_id_t actor, message_t message);
+
+#define ACTOR_GROUP_BALANCE 0
+#define ACTOR_GROUP_ROUND_ROBIN 1
+#define ACTOR_GROUP_RANDOM 2
+#define ACTOR_GROUP_HASH 3
+
+// BALANCE members share one queue and an idle member takes the next message;
+// the other routings pick a member per message, HASH by key(message).
+typedef struct actor_group_config
+{
+    int routing;
+    size_t members;
+    uint64_t (*key)(message_t const *message);
+} actor_group_config_t;
+
+// The group id is addressed like any actor; a godie sent to it ends every member
+// once the messages already sent to the group are handled.
+int actor_group_create(actor_id_t *group, role_ctx_t *const role, actor_group_config_t const *config);
+
+#define FUTURE_SUCCESS 0
+#define FUTURE_BROKEN -1
+#define FUTURE_TIMEOUT -2
+
+// Reply slot for ask; a role_ctx_t actor answers it with ctx_reply.
+typedef struct future
+{
+    void *promise;
+} future_t;
+
+int ask(actor_id_t actor, message_t message, future_t *future);
+
+int future_wait(future_t *future, message_t *reply);
+
+int future_wait_for(future_t *future, message_t *reply, long timeout_ms);
+
+void future_destroy(future_t *future);
+
+// Runs the actor's handlers on coroutine stacks, so they may suspend in ctx_await
+// and ctx_sleep; on a group id it applies to every member. A spawned actor can
+// turn it on from its hello. Until a suspended handler ends the actor takes no
+// other message, while its worker runs other actors.
+int actor_suspendable(actor_id_t actor);
+
+// Lets several workers run the actor at once, each handling one message, so one id
+// can keep as many workers busy as its mailbox has messages. Its handlers must be
+// safe to run concurrently: they share the state, and messages are handled in no
+// particular order, including the ones it sends itself. On a group id it applies
+// to every member. Balancing groups and suspendable actors cannot be reentrant.
+int actor_reentrant(actor_id_t actor);
+
+// Lets actors of role take up to max (at most ACTOR_BATCH_MAX) messages of type,
+// any of its prompts but the hello, off their mailbox at once and handle them in
+// one call of prompt. A batch is a run of consecutive messages of the type from
+// any senders; it ends before an ask or a message with a deadline. Batch prompts
+// run straight on the worker, so they cannot suspend. Set them up while no system
+// is running.
+int actor_batch_prompt(role_ctx_t const *role, message_type_t type, act_batch_t prompt, size_t max);
+
+// Sheds the oldest messages the actor takes from its mailbox while depth or more
+// wait behind them, 0 for no limit; a message past its deadline is shed anyway.
+// expired, if not NULL, gets each shed message instead of its handler, and an ask it
+// does not answer is broken. Spawns, godies and hellos are never shed. On a group
+// id it applies to every member; balancing members only shed by deadline.
+int actor_shed(actor_id_t actor, size_t depth, act_ctx_t expired);
+
+// Asks actor and suspends the handler until the answer, which is stored in reply
+// like future_wait does; FUTURE_SUCCESS, FUTURE_BROKEN, or a send error.
+int ctx_await(actor_ctx_t *ctx, actor_id_t actor, message_t message, message_t *reply);
+
+// Suspends the handler for ms milliseconds.
+int ctx_sleep(actor_ctx_t *ctx, long ms);
+
 #endif /* CACTI_H */
@@ -0,0 +1,541 @@
+#include "cacti_io.h"
+#include "cacti_node.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IO_EVENTS 64
+// how often completions waiting for room in a mailbox are offered again
+#define IO_PARK_MS 1
+
+// req - one submitted read, write or accept; only the I/O thread touches it once
+// it is off the submission list
+typedef struct io_req {
+	int op;
+	int fd;
+	actor_id_t actor;
+	message_type_t type;
+	long long offset;
+	// how much to read, or how much of source is written
+	size_t nbytes;
+	size_t done;
+	long result;
+	bool sock;
+	// keeps a quiescent system running until the completion is delivered
+	unsigned hold;
+	// the completion message, with room for what is read
+	actor_buffer_t* completion;
+	actor_buffer_t* source;
+	struct io_req* next;
+} io_req_t;
+
+// fd - requests waiting on one descriptor: reads and accepts, and writes apart,
+// so a read waiting for the peer never holds back a write the peer waits for
+typedef struct io_fd {
+	io_req_t* in;
+	io_req_t* in_tail;
+	io_req_t* out;
+	io_req_t* out_tail;
+	// what the descriptor is registered for in epoll
+	uint32_t events;
+	// the caller's flags, put back once no request waits on it
+	int flags;
+	bool restore;
+} io_fd_t;
+
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static io_req_t* submitted = NULL;
+static io_req_t* submitted_tail = NULL;
+
+// only the I/O thread touches these, indexed by descriptor
+static io_fd_t** io_fds = NULL;
+static size_t io_nfds = 0;
+// completions whose actor's mailbox was full, in the order they finished
+static io_req_t* parked = NULL;
+static io_req_t* parked_tail = NULL;
+
+static int epoll_fd = -1;
+static int event_fd = -1;
+static pthread_t io_thread;
+static bool started = false;
+static _Atomic bool stopping;
+static _Atomic size_t dropped;
+
+static void io_free(io_req_t* r) {
+	if (r->completion != NULL)
+		buffer_release(r->completion);
+
+	if (r->source != NULL)
+		buffer_release(r->source);
+
+	actor_node_release(r->hold);
+	free(r);
+}
+
+// false while the actor's mailbox is full
+static bool io_deliver(io_req_t* r) {
+	int ret = actor_node_deliver(r->actor, ACTOR_ID_NONE, r->type, r->completion);
+
+	if (ret == ACTOR_NODE_FULL)
+		return false;
+
+	if (ret != 0)
+		++dropped;
+
+	io_free(r);
+	return true;
+}
+
+// offers the parked completions again, oldest first
+static void io_unpark() {
+	while (parked != NULL && io_deliver(parked)) {
+		parked = parked->next;
+		if (parked == NULL)
+			parked_tail = NULL;
+	}
+}
+
+// the I/O thread never waits for an actor: a completion that finds the mailbox
+// full is parked, and so is everything after it until the parked ones got in
+static void io_complete(io_req_t* r, long result) {
+	actor_io_t* io = (actor_io_t*)buffer_data(r->completion);
+	io->op = r->op;
+	io->fd = r->fd;
+	io->result = result;
+	r->next = NULL;
+
+	if (parked == NULL && io_deliver(r))
+		return;
+
+	if (parked == NULL)
+		parked = r;
+	else
+		parked_tail->next = r;
+
+	parked_tail = r;
+}
+
+// false while the descriptor is not ready, otherwise r->result is set
+static bool io_attempt(io_req_t* r) {
+	actor_io_t* io = (actor_io_t*)buffer_data(r->completion);
+	ssize_t n = 0;
+
+	switch (r->op) {
+		case ACTOR_IO_READ:
+			do {
+				n = r->offset < 0 ? read(r->fd, io->data, r->nbytes) : pread(r->fd, io->data, r->nbytes, r->offset);
+			} while (n < 0 && errno == EINTR);
+			break;
+
+		case ACTOR_IO_WRITE:
+			while (r->done < r->nbytes) {
+				char const* from = (char const*)buffer_data(r->source) + r->done;
+				size_t left = r->nbytes - r->done;
+
+				if (r->offset >= 0)
+					n = pwrite(r->fd, from, left, r->offset + (long long)r->done);
+				else if (r->sock)
+					n = send(r->fd, from, left, MSG_NOSIGNAL);
+				else
+					n = write(r->fd, from, left);
+
+				if (n < 0 && errno == EINTR)
+					continue;
+
+				if (n < 0)
+					break;
+
+				r->done += (size_t)n;
+			}
+
+			if (r->done == r->nbytes)
+				n = (ssize_t)r->done;
+			break;
+
+		default:
+			do {
+				n = accept(r->fd, NULL, NULL);
+			} while (n < 0 && errno == EINTR);
+			break;
+	}
+
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return false;
+
+	r->result = n < 0 ? -errno : (long)n;
+	return true;
+}
+
+static io_fd_t* io_fd_get(int fd) {
+	if ((size_t)fd >= io_nfds) {
+		size_t n = io_nfds > 0 ? io_nfds : 64;
+		while (n <= (size_t)fd)
+			n *= 2;
+
+		io_fd_t** grown = (io_fd_t**)realloc(io_fds, sizeof(io_fd_t*) * n);
+		if (grown == NULL)
+			exit(-1);
+
+		memset(grown + io_nfds, 0, sizeof(io_fd_t*) * (n - io_nfds));
+		io_fds = grown;
+		io_nfds = n;
+	}
+
+	if (io_fds[fd] == NULL && (io_fds[fd] = (io_fd_t*)calloc(1, sizeof(io_fd_t))) == NULL)
+		exit(-1);
+
+	return io_fds[fd];
+}
+
+// the thread must not block on anything but a regular file while requests wait on it
+static void io_nonblock(int fd, io_fd_t* f) {
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || (flags & O_NONBLOCK) != 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+		return;
+
+	f->flags = flags;
+	f->restore = true;
+}
+
+static void io_restore(int fd, io_fd_t* f) {
+	if (f->restore)
+		fcntl(fd, F_SETFL, f->flags);
+
+	f->restore = false;
+}
+
+static void io_fail(io_req_t** list, long result) {
+	while (*list != NULL) {
+		io_req_t* r = *list;
+		*list = r->next;
+		io_complete(r, result);
+	}
+}
+
+// registers the descriptor for what its waiting requests need
+static void io_watch(int fd, io_fd_t* f) {
+	uint32_t want = (f->in != NULL ? EPOLLIN : 0) | (f->out != NULL ? EPOLLOUT : 0);
+
+	if (want == 0)
+		io_restore(fd, f);
+
+	if (want == f->events)
+		return;
+
+	struct epoll_event ev;
+	ev.events = want;
+	ev.data.fd = fd;
+
+	int ret = 0;
+
+	if (want == 0)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	else if (f->events == 0 && (ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev)) != 0 && errno == EEXIST)
+		ret = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	// a descriptor closed and opened again is gone from epoll
+	else if (f->events != 0 && (ret = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev)) != 0 && errno == ENOENT)
+		ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+	if (ret != 0) {
+		long result = -errno;
+		f->events = 0;
+		io_restore(fd, f);
+		io_fail(&(f->in), result);
+		io_fail(&(f->out), result);
+		return;
+	}
+
+	f->events = want;
+}
+
+// moves the requests at the front of list that went through onto done
+static void io_settle(io_req_t** list, io_req_t*** done) {
+	while (*list != NULL && io_attempt(*list)) {
+		io_req_t* r = *list;
+		*list = r->next;
+		r->next = NULL;
+		**done = r;
+		*done = &(r->next);
+	}
+}
+
+static void io_progress(int fd) {
+	io_fd_t* f = io_fd_get(fd);
+	io_req_t* done = NULL;
+	io_req_t** done_tail = &done;
+
+	io_settle(&(f->in), &done_tail);
+	io_settle(&(f->out), &done_tail);
+	io_watch(fd, f);
+
+	// delivered once the descriptor has its own flags back, if nothing waits on it anymore
+	while (done != NULL) {
+		io_req_t* next = done->next;
+		io_complete(done, done->result);
+		done = next;
+	}
+}
+
+// what was submitted goes behind the requests already waiting on its descriptor
+static void io_take() {
+	uint64_t count;
+	while (read(event_fd, &count, sizeof(count)) > 0);
+
+	if (pthread_mutex_lock(&submit_lock) != 0)
+		exit(-1);
+
+	io_req_t* r = submitted;
+	submitted = submitted_tail = NULL;
+
+	if (pthread_mutex_unlock(&submit_lock) != 0)
+		exit(-1);
+
+	while (r != NULL) {
+		io_req_t* next = r->next;
+		r->next = NULL;
+
+		struct stat st;
+
+		if (fstat(r->fd, &st) != 0) {
+			io_complete(r, -errno);
+			r = next;
+			continue;
+		}
+
+		r->sock = S_ISSOCK(st.st_mode);
+
+		io_fd_t* f = io_fd_get(r->fd);
+
+		// regular files are always ready; everything else is non-blocking while requests wait
+		if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode) && f->in == NULL && f->out == NULL)
+			io_nonblock(r->fd, f);
+		io_req_t** head = r->op == ACTOR_IO_WRITE ? &(f->out) : &(f->in);
+		io_req_t** tail = r->op == ACTOR_IO_WRITE ? &(f->out_tail) : &(f->in_tail);
+
+		if (*head == NULL)
+			*head = r;
+		else
+			(*tail)->next = r;
+
+		*tail = r;
+		io_progress(r->fd);
+		r = next;
+	}
+}
+
+static void* io_loop(void* arg) {
+	(void)arg;
+	struct epoll_event events[IO_EVENTS];
+
+	while (!stopping) {
+		io_unpark();
+
+		int n = epoll_wait(epoll_fd, events, IO_EVENTS, parked != NULL ? IO_PARK_MS : -1);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			exit(-1);
+		}
+
+		for (int i = 0; i < n; ++i) {
+			if (events[i].data.fd == event_fd)
+				io_take();
+			else
+				io_progress(events[i].data.fd);
+		}
+	}
+
+	return NULL;
+}
+
+static int io_submit(io_req_t* r) {
+	if (pthread_mutex_lock(&submit_lock) != 0)
+		exit(-1);
+
+	if (!started) {
+		if (pthread_mutex_unlock(&submit_lock) != 0)
+			exit(-1);
+
+		io_free(r);
+		return -1;
+	}
+
+	bool wake = submitted == NULL;
+
+	// taken before the I/O thread may see the request, so the completion gives it back
+	r->hold = actor_node_hold();
+
+	if (submitted == NULL)
+		submitted = r;
+	else
+		submitted_tail->next = r;
+
+	submitted_tail = r;
+
+	if (pthread_mutex_unlock(&submit_lock) != 0)
+		exit(-1);
+
+	uint64_t one = 1;
+
+	if (wake && write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -1;
+
+	return 0;
+}
+
+static io_req_t* io_req(int op, actor_id_t actor, message_type_t type, int fd, size_t room) {
+	io_req_t* r = (io_req_t*)malloc(sizeof(io_req_t));
+	if (r == NULL)
+		return NULL;
+
+	r->completion = buffer_create(sizeof(actor_io_t) + room);
+	if (r->completion == NULL) {
+		free(r);
+		return NULL;
+	}
+
+	r->op = op;
+	r->fd = fd;
+	r->actor = actor;
+	r->type = type;
+	r->offset = -1;
+	r->nbytes = room;
+	r->done = 0;
+	r->result = 0;
+	r->sock = false;
+	r->hold = 0;
+	r->source = NULL;
+	r->next = NULL;
+	return r;
+}
+
+int actor_io_start() {
+	if (started)
+		return -1;
+
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return -1;
+
+	if ((event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		close(epoll_fd);
+		return -1;
+	}
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = event_fd;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev) != 0) {
+		close(event_fd);
+		close(epoll_fd);
+		return -1;
+	}
+
+	stopping = false;
+	dropped = 0;
+
+	if (pthread_create(&io_thread, NULL, io_loop, NULL) != 0) {
+		close(event_fd);
+		close(epoll_fd);
+		return -1;
+	}
+
+	started = true;
+	return 0;
+}
+
+int actor_io_read(actor_id_t actor, message_type_t type, int fd, size_t nbytes, long long offset) {
+	io_req_t* r = io_req(ACTOR_IO_READ, actor, type, fd, nbytes);
+	if (r == NULL)
+		return -1;
+
+	r->offset = offset;
+	return io_submit(r);
+}
+
+int actor_io_write(actor_id_t actor, message_type_t type, int fd, actor_buffer_t* buffer, long long offset) {
+	io_req_t* r = io_req(ACTOR_IO_WRITE, actor, type, fd, 0);
+	if (r == NULL) {
+		buffer_release(buffer);
+		return -1;
+	}
+
+	r->offset = offset;
+	r->nbytes = buffer_size(buffer);
+	r->source = buffer;
+	return io_submit(r);
+}
+
+int actor_io_accept(actor_id_t actor, message_type_t type, int fd) {
+	io_req_t* r = io_req(ACTOR_IO_ACCEPT, actor, type, fd, 0);
+	if (r == NULL)
+		return -1;
+
+	return io_submit(r);
+}
+
+static void io_drop(io_req_t* r) {
+	while (r != NULL) {
+		io_req_t* next = r->next;
+		io_free(r);
+		++dropped;
+		r = next;
+	}
+}
+
+int actor_io_stop() {
+	if (!started)
+		return -1;
+
+	// nothing is submitted after this, and what was is dropped once the thread is gone
+	if (pthread_mutex_lock(&submit_lock) != 0)
+		exit(-1);
+
+	started = false;
+
+	if (pthread_mutex_unlock(&submit_lock) != 0)
+		exit(-1);
+
+	stopping = true;
+
+	uint64_t one = 1;
+	if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		exit(-1);
+
+	if (pthread_join(io_thread, NULL) != 0)
+		exit(-1);
+
+	io_drop(submitted);
+	submitted = submitted_tail = NULL;
+	io_drop(parked);
+	parked = parked_tail = NULL;
+
+	for (size_t fd = 0; fd < io_nfds; ++fd) {
+		if (io_fds[fd] != NULL) {
+			io_restore((int)fd, io_fds[fd]);
+			io_drop(io_fds[fd]->in);
+			io_drop(io_fds[fd]->out);
+			free(io_fds[fd]);
+		}
+	}
+
+	free(io_fds);
+	io_fds = NULL;
+	io_nfds = 0;
+
+	close(event_fd);
+	close(epoll_fd);
+	return 0;
+}
+
+size_t actor_io_dropped() {
+	return dropped;
+}
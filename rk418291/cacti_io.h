@@ -0,0 +1,52 @@
+#ifndef CACTI_IO_H
+#define CACTI_IO_H
+
+#include "cacti.h"
+
+// Reads, writes and accepts that would block a worker are handed to the process's
+// I/O thread instead, and each comes back to an actor as a message of the type it
+// was submitted with. Sockets and pipes are switched to non-blocking while
+// requests wait on them in epoll, and get their own flags back before the last
+// completion is delivered; regular files are read and written right away on the
+// I/O thread. Requests on one descriptor complete in the order they were
+// submitted, reads and accepts apart from writes. A descriptor may only be closed
+// once its requests have completed. A quiescent system keeps running while its
+// actors have requests pending.
+
+#define ACTOR_IO_READ 0
+#define ACTOR_IO_WRITE 1
+#define ACTOR_IO_ACCEPT 2
+
+// What a completion message carries. It is the data of a buffer, so a handler
+// that wants to keep what was read can take it with buffer_of and buffer_retain
+// instead of copying it out. result is the number of bytes read or written, the
+// accepted descriptor, or -errno.
+typedef struct actor_io
+{
+    int op;
+    int fd;
+    long result;
+    // what was read, result bytes of it
+    char data[];
+} actor_io_t;
+
+// Starts the I/O thread.
+int actor_io_start();
+
+// Reads up to nbytes from fd at offset, or from where fd is when offset is negative.
+int actor_io_read(actor_id_t actor, message_type_t type, int fd, size_t nbytes, long long offset);
+
+// Writes all of buffer to fd at offset, or where fd is when offset is negative.
+// Takes over the caller's reference to buffer, which is written from as it is.
+int actor_io_write(actor_id_t actor, message_type_t type, int fd, actor_buffer_t *buffer, long long offset);
+
+// Accepts a connection on the listening socket fd.
+int actor_io_accept(actor_id_t actor, message_type_t type, int fd);
+
+// Stops the I/O thread; requests that have not completed are dropped.
+int actor_io_stop();
+
+// Completions that found their actor or its system gone, and requests dropped by actor_io_stop.
+size_t actor_io_dropped();
+
+#endif
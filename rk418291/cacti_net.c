@@ -0,0 +1,781 @@
+#include "cacti_net.h"
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NET_MAGIC	0x54454e4954434143ULL
+
+// what a connector says first: NET_MAGIC and its node
+#define NET_HELLO_SIZE	16
+// every frame: payload length, target, sender and type, then the payload
+#define NET_HEADER_SIZE	32
+
+// sends fail while this much is queued on a connection and not yet written, so a
+// worker never waits on the network; the caller retries or sheds the message
+#define NET_BUFFER_LIMIT	(4 << 20)
+#define NET_READ_SIZE	(64 << 10)
+// a longer frame breaks the connection, so a peer cannot make the reader hold more
+#define NET_FRAME_LIMIT	(16 << 20)
+// how often a frame waiting for room in a mailbox is offered again
+#define NET_PARK_MS	1
+// how long actor_net_stop tries to get queued messages out
+#define NET_DRAIN_MS	1000
+
+typedef struct net_buf {
+	char* data;
+	size_t len;
+	size_t cap;
+} net_buf_t;
+
+// conn - connection to one other node; only freed by actor_net_stop
+typedef struct net_conn {
+	actor_transport_t transport;
+	int fd;
+	int node; // -1 until the connector's hello arrives
+	_Atomic bool dead;
+	pthread_mutex_t lock;
+	// senders append frames to out; the I/O thread swaps it with flush to write
+	// all of them at once, so messages sent meanwhile coalesce into one write
+	net_buf_t out;
+	net_buf_t flush;
+	size_t flushed;
+	net_buf_t in;
+	// the decoded frame at the head of in while its target's mailbox is full;
+	// nothing more is read from the connection until it got in
+	actor_buffer_t* parked;
+	struct net_conn* next;
+} net_conn_t;
+
+typedef struct net_type {
+	message_type_t type;
+	actor_serializer_t const* serializer;
+} net_type_t;
+
+static net_type_t net_types[ACTOR_NET_TYPES];
+static size_t net_ntypes = 0;
+
+static pthread_mutex_t conns_lock = PTHREAD_MUTEX_INITIALIZER;
+static net_conn_t* conns = NULL;
+static net_conn_t* peers[ACTOR_NODE_LIMIT];
+static int listen_fd = -1;
+static int wake_fd[2] = {-1, -1};
+static pthread_t io_thread;
+static bool started = false;
+static _Atomic bool stopping;
+static _Atomic size_t dropped;
+static int net_node;
+
+static size_t flat_size(size_t nbytes, void const* data) {
+	(void)data;
+	return nbytes;
+}
+
+static void flat_encode(size_t nbytes, void const* data, void* out) {
+	memcpy(out, data, nbytes);
+}
+
+static actor_buffer_t* flat_decode(void const* bytes, size_t length) {
+	actor_buffer_t* buffer = buffer_create(length);
+
+	if (buffer != NULL)
+		memcpy(buffer_data(buffer), bytes, length);
+
+	return buffer;
+}
+
+actor_serializer_t const actor_serializer_flat = {flat_size, flat_encode, flat_decode};
+
+static actor_serializer_t const* net_serializer(message_type_t type) {
+	for (size_t i = 0; i < net_ntypes; ++i) {
+		if (net_types[i].type == type)
+			return net_types[i].serializer;
+	}
+
+	return NULL;
+}
+
+int actor_net_serializer(message_type_t type, actor_serializer_t const* serializer) {
+	for (size_t i = 0; i < net_ntypes; ++i) {
+		if (net_types[i].type == type) {
+			net_types[i].serializer = serializer;
+			return 0;
+		}
+	}
+
+	if (started || net_ntypes == ACTOR_NET_TYPES)
+		return -1;
+
+	net_types[net_ntypes].type = type;
+	net_types[net_ntypes].serializer = serializer;
+	++net_ntypes;
+	return 0;
+}
+
+static bool buf_reserve(net_buf_t* b, size_t extra) {
+	if (b->len + extra <= b->cap)
+		return true;
+
+	size_t cap = b->cap > 0 ? b->cap : 4096;
+	while (cap < b->len + extra)
+		cap *= 2;
+
+	char* data = (char*)realloc(b->data, cap);
+	if (data == NULL)
+		return false;
+
+	b->data = data;
+	b->cap = cap;
+	return true;
+}
+
+static void put64(char* p, uint64_t value) {
+	value = htobe64(value);
+	memcpy(p, &value, sizeof(value));
+}
+
+static uint64_t get64(char const* p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return be64toh(value);
+}
+
+static void net_wake() {
+	char c = 0;
+
+	// a full pipe already wakes the I/O thread
+	if (write(wake_fd[1], &c, 1) < 0 && errno != EAGAIN)
+		exit(-1);
+}
+
+static int net_send(void* self, int node, actor_id_t target, actor_id_t sender, message_t msg) {
+	(void)node;
+	net_conn_t* c = (net_conn_t*)self;
+	actor_serializer_t const* serializer = NULL;
+
+	// a payload only leaves the process in the form its serializer gives it
+	if (msg.nbytes > 0 && (serializer = net_serializer(msg.message_type)) == NULL)
+		return -1;
+
+	size_t length = serializer != NULL ? serializer->size(msg.nbytes, msg.data) : 0;
+
+	if (length > NET_FRAME_LIMIT)
+		return -1;
+
+	if (pthread_mutex_lock(&(c->lock)) != 0)
+		exit(-1);
+
+	if (c->dead || c->out.len >= NET_BUFFER_LIMIT || !buf_reserve(&(c->out), NET_HEADER_SIZE + length)) {
+		if (pthread_mutex_unlock(&(c->lock)) != 0)
+			exit(-1);
+		return -1;
+	}
+
+	bool wake = c->out.len == 0;
+	char* frame = c->out.data + c->out.len;
+
+	put64(frame, length);
+	put64(frame + 8, (uint64_t)target);
+	put64(frame + 16, (uint64_t)sender);
+	put64(frame + 24, (uint64_t)msg.message_type);
+	if (length > 0)
+		serializer->encode(msg.nbytes, msg.data, frame + NET_HEADER_SIZE);
+
+	c->out.len += NET_HEADER_SIZE + length;
+
+	if (pthread_mutex_unlock(&(c->lock)) != 0)
+		exit(-1);
+
+	if (wake)
+		net_wake();
+
+	return 0;
+}
+
+static net_conn_t* net_conn_create(int fd, int node) {
+	net_conn_t* c = (net_conn_t*)calloc(1, sizeof(net_conn_t));
+	if (c == NULL)
+		return NULL;
+
+	if (pthread_mutex_init(&(c->lock), NULL) != 0) {
+		free(c);
+		return NULL;
+	}
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	c->transport.send = net_send;
+	c->transport.self = c;
+	c->fd = fd;
+	c->node = node;
+	c->dead = false;
+	return c;
+}
+
+static void net_conn_destroy(net_conn_t* c) {
+	if (c->fd >= 0)
+		close(c->fd);
+
+	if (c->parked != NULL)
+		buffer_release(c->parked);
+
+	pthread_mutex_destroy(&(c->lock));
+	free(c->out.data);
+	free(c->flush.data);
+	free(c->in.data);
+	free(c);
+}
+
+// assumes you have conns_lock acquired
+static void net_add(net_conn_t* c) {
+	c->next = conns;
+	conns = c;
+}
+
+// assumes you have conns_lock acquired; returns false if another live connection
+// already carries c's node
+static bool net_route(net_conn_t* c) {
+	// actor_net_stop took the routes down for good
+	if (stopping)
+		return true;
+
+	if (peers[c->node] != NULL && !peers[c->node]->dead)
+		return false;
+
+	peers[c->node] = c;
+	actor_node_route(c->node, &(c->transport));
+	return true;
+}
+
+// the peer is gone: sends already framed are lost, later sends find no route
+static void net_drop(net_conn_t* c) {
+	if (pthread_mutex_lock(&(c->lock)) != 0)
+		exit(-1);
+
+	c->dead = true;
+	close(c->fd);
+	c->fd = -1;
+
+	if (pthread_mutex_unlock(&(c->lock)) != 0)
+		exit(-1);
+
+	if (pthread_mutex_lock(&conns_lock) != 0)
+		exit(-1);
+
+	if (c->node >= 0 && peers[c->node] == c) {
+		peers[c->node] = NULL;
+		actor_node_route(c->node, NULL);
+	}
+
+	if (pthread_mutex_unlock(&conns_lock) != 0)
+		exit(-1);
+}
+
+// writes what is queued until the socket would block; senders only wake the I/O
+// thread when out was empty, so whatever they queued meanwhile goes out here too
+static void net_flush(net_conn_t* c) {
+	while (true) {
+		if (c->flushed == c->flush.len) {
+			if (pthread_mutex_lock(&(c->lock)) != 0)
+				exit(-1);
+
+			bool empty = c->out.len == 0;
+
+			if (!empty) {
+				net_buf_t swap = c->flush;
+				c->flush = c->out;
+				c->out = swap;
+				c->out.len = 0;
+				c->flushed = 0;
+			}
+
+			if (pthread_mutex_unlock(&(c->lock)) != 0)
+				exit(-1);
+
+			if (empty)
+				return;
+		}
+
+		ssize_t n = write(c->fd, c->flush.data + c->flushed, c->flush.len - c->flushed);
+
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0) {
+			net_drop(c);
+			return;
+		}
+
+		c->flushed += (size_t)n;
+	}
+}
+
+// false while the target's mailbox is full; the frame is then kept decoded in
+// c->parked and offered again later, so the I/O thread never waits on one actor
+static bool net_deliver(net_conn_t* c, actor_id_t target, actor_id_t sender, message_type_t type,
+		char const* bytes, size_t length) {
+	actor_serializer_t const* serializer = net_serializer(type);
+	actor_buffer_t* buffer = c->parked;
+
+	c->parked = NULL;
+
+	if (buffer == NULL && length == 0)
+		buffer = buffer_create(0);
+	else if (buffer == NULL && serializer != NULL)
+		buffer = serializer->decode(bytes, length);
+
+	if (buffer == NULL) {
+		++dropped;
+		return true;
+	}
+
+	int ret = actor_node_deliver(target, sender, type, buffer);
+
+	if (ret == ACTOR_NODE_FULL) {
+		c->parked = buffer;
+		return false;
+	}
+
+	if (ret != 0)
+		++dropped;
+
+	buffer_release(buffer);
+	return true;
+}
+
+// returns false once the connection is broken
+static bool net_parse(net_conn_t* c) {
+	size_t pos = 0;
+
+	if (c->node < 0) {
+		if (c->in.len < NET_HELLO_SIZE)
+			return true;
+
+		uint64_t node = get64(c->in.data + 8);
+
+		if (get64(c->in.data) != NET_MAGIC || node >= ACTOR_NODE_LIMIT)
+			return false;
+
+		// a peer claiming to be us, or a node we are already connected to, would
+		// take over the route of a connection that works
+		if ((int)node == net_node)
+			return false;
+
+		c->node = (int)node;
+		pos = NET_HELLO_SIZE;
+
+		if (pthread_mutex_lock(&conns_lock) != 0)
+			exit(-1);
+
+		bool routed = net_route(c);
+
+		if (pthread_mutex_unlock(&conns_lock) != 0)
+			exit(-1);
+
+		if (!routed)
+			return false;
+	}
+
+	while (c->in.len - pos >= NET_HEADER_SIZE) {
+		char const* frame = c->in.data + pos;
+		uint64_t length = get64(frame);
+
+		if (length > NET_FRAME_LIMIT)
+			return false;
+
+		if (c->in.len - pos - NET_HEADER_SIZE < length)
+			break;
+
+		if (!net_deliver(c, (actor_id_t)get64(frame + 8), (actor_id_t)get64(frame + 16),
+				(message_type_t)get64(frame + 24), frame + NET_HEADER_SIZE, length))
+			break;
+
+		pos += NET_HEADER_SIZE + length;
+	}
+
+	memmove(c->in.data, c->in.data + pos, c->in.len - pos);
+	c->in.len -= pos;
+	return true;
+}
+
+static void net_read(net_conn_t* c) {
+	// the connection is held back while a frame waits for room
+	while (c->parked == NULL) {
+		if (!buf_reserve(&(c->in), NET_READ_SIZE)) {
+			net_drop(c);
+			return;
+		}
+
+		ssize_t n = read(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len);
+
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0) {
+			net_drop(c);
+			return;
+		}
+
+		c->in.len += (size_t)n;
+
+		if (!net_parse(c)) {
+			net_drop(c);
+			return;
+		}
+	}
+}
+
+static void net_accept() {
+	while (true) {
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if (fd < 0)
+			return;
+
+		net_conn_t* c = net_conn_create(fd, -1);
+
+		if (c == NULL) {
+			close(fd);
+			continue;
+		}
+
+		if (pthread_mutex_lock(&conns_lock) != 0)
+			exit(-1);
+
+		net_add(c);
+
+		if (pthread_mutex_unlock(&conns_lock) != 0)
+			exit(-1);
+	}
+}
+
+// what was sent before actor_net_stop still goes out, unless peers stall
+static void net_drain() {
+	for (int waited = 0; waited < NET_DRAIN_MS; ++waited) {
+		bool pending = false;
+
+		for (net_conn_t* c = conns; c != NULL; c = c->next) {
+			if (!c->dead)
+				net_flush(c);
+
+			if (!c->dead && c->flushed < c->flush.len)
+				pending = true;
+		}
+
+		if (!pending)
+			return;
+
+		usleep(1000);
+	}
+}
+
+static void* net_io(void* arg) {
+	(void)arg;
+	struct pollfd* fds = NULL;
+	net_conn_t** polled = NULL;
+	size_t size = 0;
+
+	while (!stopping) {
+		// connections are only added at the head and never freed while this runs,
+		// so the list can be walked from a snapshot of the head
+		if (pthread_mutex_lock(&conns_lock) != 0)
+			exit(-1);
+
+		net_conn_t* head = conns;
+		int listening = listen_fd;
+
+		if (pthread_mutex_unlock(&conns_lock) != 0)
+			exit(-1);
+
+		size_t n = 2;
+		bool parked = false;
+		for (net_conn_t* c = head; c != NULL; c = c->next)
+			++n;
+
+		if (n > size) {
+			size = n * 2;
+			fds = (struct pollfd*)realloc(fds, sizeof(struct pollfd) * size);
+			polled = (net_conn_t**)realloc(polled, sizeof(net_conn_t*) * size);
+			if (fds == NULL || polled == NULL)
+				exit(-1);
+		}
+
+		fds[0].fd = wake_fd[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = listening;
+		fds[1].events = POLLIN;
+		n = 2;
+
+		for (net_conn_t* c = head; c != NULL; c = c->next) {
+			if (c->dead)
+				continue;
+
+			// a parked frame is offered again before anything else of its connection
+			if (c->parked != NULL && !net_parse(c))
+				net_drop(c);
+
+			if (c->dead)
+				continue;
+
+			net_flush(c);
+			if (c->dead)
+				continue;
+
+			// a connection held back is left out of the poll and its writes go out every
+			// NET_PARK_MS; the kernel buffers fill up and the peer's senders wait for room
+			polled[n] = c;
+			fds[n].fd = c->parked != NULL ? -1 : c->fd;
+			fds[n].events = POLLIN | (c->flushed < c->flush.len ? POLLOUT : 0);
+			parked = parked || c->parked != NULL;
+			++n;
+		}
+
+		if (poll(fds, n, parked ? NET_PARK_MS : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			exit(-1);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			char drain[64];
+			while (read(wake_fd[0], drain, sizeof(drain)) > 0);
+		}
+
+		if (fds[1].revents & POLLIN)
+			net_accept();
+
+		for (size_t i = 2; i < n; ++i) {
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				net_read(polled[i]);
+		}
+	}
+
+	net_drain();
+
+	free(fds);
+	free(polled);
+	return NULL;
+}
+
+int actor_net_start(int node) {
+	if (started || node < 0 || node >= ACTOR_NODE_LIMIT)
+		return -1;
+
+	if (pipe(wake_fd) != 0)
+		return -1;
+
+	fcntl(wake_fd[0], F_SETFL, fcntl(wake_fd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(wake_fd[1], F_SETFL, fcntl(wake_fd[1], F_GETFL) | O_NONBLOCK);
+
+	stopping = false;
+	dropped = 0;
+	net_node = node;
+
+	if (pthread_create(&io_thread, NULL, net_io, NULL) != 0) {
+		close(wake_fd[0]);
+		close(wake_fd[1]);
+		return -1;
+	}
+
+	started = true;
+	actor_node_set_self(node);
+	return 0;
+}
+
+static struct addrinfo* net_resolve(char const* host, uint16_t port, bool passive) {
+	char service[8];
+	snprintf(service, sizeof(service), "%u", (unsigned)port);
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+	struct addrinfo* res = NULL;
+	if (getaddrinfo(host, service, &hints, &res) != 0)
+		return NULL;
+
+	return res;
+}
+
+int actor_net_listen(char const* host, uint16_t* port) {
+	if (!started || listen_fd >= 0)
+		return -1;
+
+	struct addrinfo* res = net_resolve(host, *port, true);
+	if (res == NULL)
+		return -1;
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	int one = 1;
+
+	if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+			|| bind(fd, res->ai_addr, res->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0) {
+		if (fd >= 0)
+			close(fd);
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	freeaddrinfo(res);
+
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+
+	if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	*port = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6*)&addr)->sin6_port
+		: ((struct sockaddr_in*)&addr)->sin_port);
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	if (pthread_mutex_lock(&conns_lock) != 0)
+		exit(-1);
+
+	listen_fd = fd;
+
+	if (pthread_mutex_unlock(&conns_lock) != 0)
+		exit(-1);
+
+	net_wake();
+	return 0;
+}
+
+int actor_net_connect(int node, char const* host, uint16_t port) {
+	if (!started || node < 0 || node >= ACTOR_NODE_LIMIT || node == net_node)
+		return -1;
+
+	if (pthread_mutex_lock(&conns_lock) != 0)
+		exit(-1);
+
+	bool connected = peers[node] != NULL && !peers[node]->dead;
+
+	if (pthread_mutex_unlock(&conns_lock) != 0)
+		exit(-1);
+
+	if (connected)
+		return 0;
+
+	struct addrinfo* res = net_resolve(host, port, false);
+	if (res == NULL)
+		return -1;
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+		if (fd >= 0)
+			close(fd);
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	freeaddrinfo(res);
+
+	net_conn_t* c = net_conn_create(fd, node);
+
+	if (c == NULL || !buf_reserve(&(c->out), NET_HELLO_SIZE)) {
+		if (c != NULL)
+			net_conn_destroy(c);
+		else
+			close(fd);
+		return -1;
+	}
+
+	// the hello goes out ahead of every frame
+	put64(c->out.data, NET_MAGIC);
+	put64(c->out.data + 8, (uint64_t)net_node);
+	c->out.len = NET_HELLO_SIZE;
+
+	if (pthread_mutex_lock(&conns_lock) != 0)
+		exit(-1);
+
+	// if the node connected to us meanwhile, it turns this hello down and the
+	// connection closes without ever carrying a message
+	net_add(c);
+	net_route(c);
+
+	if (pthread_mutex_unlock(&conns_lock) != 0)
+		exit(-1);
+
+	net_wake();
+	return 0;
+}
+
+int actor_net_stop() {
+	if (!started)
+		return -1;
+
+	// sends from here on find no route, and no connection gets one again
+	if (pthread_mutex_lock(&conns_lock) != 0)
+		exit(-1);
+
+	stopping = true;
+
+	for (int n = 0; n < ACTOR_NODE_LIMIT; ++n) {
+		if (peers[n] != NULL) {
+			actor_node_route(n, NULL);
+			peers[n] = NULL;
+		}
+	}
+
+	if (pthread_mutex_unlock(&conns_lock) != 0)
+		exit(-1);
+
+	net_wake();
+
+	if (pthread_join(io_thread, NULL) != 0)
+		exit(-1);
+
+	// senders that found a route before fail from here on
+	for (net_conn_t* c = conns; c != NULL; c = c->next) {
+		if (pthread_mutex_lock(&(c->lock)) != 0)
+			exit(-1);
+
+		c->dead = true;
+
+		if (pthread_mutex_unlock(&(c->lock)) != 0)
+			exit(-1);
+	}
+
+	actor_node_settle();
+	actor_node_set_self(-1);
+
+	while (conns != NULL) {
+		net_conn_t* c = conns;
+		conns = c->next;
+		net_conn_destroy(c);
+	}
+
+	if (listen_fd >= 0)
+		close(listen_fd);
+
+	close(wake_fd[0]);
+	close(wake_fd[1]);
+	listen_fd = -1;
+	started = false;
+	return 0;
+}
+
+size_t actor_net_dropped() {
+	return dropped;
+}
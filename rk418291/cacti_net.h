@@ -0,0 +1,53 @@
+#ifndef CACTI_NET_H
+#define CACTI_NET_H
+
+#include "cacti_node.h"
+
+#include <stdint.h>
+
+// Nodes on any hosts reach each other's actors over persistent TCP connections,
+// one per pair of nodes. Messages sent to a node are framed into that
+// connection's buffer and written out in batches by the process's I/O thread.
+// A send fails instead of waiting while a connection has a few megabytes not
+// yet written, so the sender can retry or shed the message.
+
+// How the payload of one message type crosses the wire. size and encode turn
+// (nbytes, data) into that many bytes; decode rebuilds the data a handler on the
+// other node gets, in a buffer it returns, or NULL when it cannot.
+typedef struct actor_serializer
+{
+    size_t (*size)(size_t nbytes, void const *data);
+    void (*encode)(size_t nbytes, void const *data, void *out);
+    actor_buffer_t *(*decode)(void const *bytes, size_t length);
+} actor_serializer_t;
+
+// Copies the nbytes bytes at data as they are; for payloads without pointers.
+extern actor_serializer_t const actor_serializer_flat;
+
+#ifndef ACTOR_NET_TYPES
+#define ACTOR_NET_TYPES 64
+#endif
+
+// Messages with a payload only go to other nodes if their type has a serializer.
+// Set them up before actor_net_start; both ends need the same ones.
+int actor_net_serializer(message_type_t type, actor_serializer_t const *serializer);
+
+// Makes this process node and starts its I/O thread.
+int actor_net_start(int node);
+
+// Accepts connections from other nodes; a port of 0 picks a free one and
+// stores it.
+int actor_net_listen(char const *host, uint16_t *port);
+
+// Connects to node at host:port, unless the two are connected already. A node
+// accepts one connection per peer and closes any that claim to be itself or a
+// peer it is connected to.
+int actor_net_connect(int node, char const *host, uint16_t port);
+
+// Closes every connection and stops the I/O thread.
+int actor_net_stop();
+
+// Messages that arrived for actors or systems that were gone, or could not be decoded.
+size_t actor_net_dropped();
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef CACTI_NODE_H
+#define CACTI_NODE_H
+
+#include "cacti.h"
+
+// Actors of other processes are addressed by ids carrying the number of their
+// node above ACTOR_NODE_SHIFT; plain ids are the actors of this process.
+#define ACTOR_NODE_SHIFT 48
+#define ACTOR_NODE_LIMIT 255
+
+// How messages leave for a node. send copies the message out before returning,
+// target is the id on that node and sender the global id of the sending actor.
+typedef struct actor_transport
+{
+    int (*send)(void *self, int node, actor_id_t target, actor_id_t sender, message_t message);
+    void *self;
+} actor_transport_t;
+
+// The global id of an actor of the given node.
+actor_id_t actor_node_id(int node, actor_id_t actor);
+
+// The node an id points to, or -1 for a plain id.
+int actor_node_of(actor_id_t actor);
+
+// The node of this process, -1 until a transport sets it.
+int actor_node_self();
+
+void actor_node_set_self(int node);
+
+// Routes sends to ids of node through transport; NULL stops them.
+int actor_node_route(int node, actor_transport_t const *transport);
+
+// Waits for sends that found a transport routed before it was unrouted to return
+// from it; a transport frees nothing a sender may touch until then.
+void actor_node_settle();
+
+#define ACTOR_NODE_FULL 1
+
+// Hands a message that arrived from another node to the local target, the
+// delivery's reference to buffer like send_buffer. Its handler sees sender as
+// ctx->sender, so ctx_reply and ctx_send answer through the transport. Returns
+// ACTOR_NODE_FULL without taking the message while the target's mailbox is full;
+// the caller holds on to it and tries again later.
+int actor_node_deliver(actor_id_t target, actor_id_t sender, message_type_t type, actor_buffer_t *buffer);
+
+// Keeps a quiescent system running for a message still to come from outside it,
+// like the completion of a pending read. The token goes back to actor_node_release
+// once that message was delivered or dropped; 0 means nothing was held. A system
+// that shuts down stops waiting for them.
+unsigned actor_node_hold();
+
+void actor_node_release(unsigned token);
+
+#endif
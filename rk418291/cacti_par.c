@@ -0,0 +1,435 @@
+#include "cacti_par.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define PAR_START	(message_type_t)1
+#define PAR_READY	(message_type_t)2
+#define PAR_WORK	(message_type_t)1
+
+#define PAR_CHUNKS_PER_WORKER	4
+
+typedef struct par_job par_job_t;
+
+struct par_job {
+	size_t begin;
+	size_t end;
+	size_t chunks;
+	size_t claims; // chunks, or the tree leaves when reducing
+	size_t actors;
+	_Atomic size_t next_claim;
+	void (*run)(par_job_t* job, size_t claim);
+
+	par_for_t body;
+	par_map_t map;
+	size_t size;
+	char* out;
+	void* arg;
+
+	// reduce: leaf i is node leaves + i, node i has children 2i and 2i + 1
+	par_leaf_t leaf;
+	par_combine_t combine;
+	size_t leaves;
+	char* nodes;
+	bool* filled;
+	_Atomic int* arrived;
+};
+
+typedef struct par_root {
+	par_job_t* job;
+	size_t ready;
+} par_root_t;
+
+static message_t par_message(message_type_t type, void* data) {
+	message_t msg;
+	msg.message_type = type;
+	msg.nbytes = data != NULL ? sizeof(par_job_t) : 0;
+	msg.data = data;
+	return msg;
+}
+
+static size_t par_workers() {
+	actor_config_t config;
+	actor_config_get(&config);
+
+	if (config.max_workers > config.min_workers)
+		return (size_t)config.max_workers;
+
+	return config.min_workers > 0 ? (size_t)config.min_workers : POOL_SIZE;
+}
+
+static void par_split(par_job_t* job, size_t len, size_t grain) {
+	job->chunks = grain > 0 ? (len + grain - 1) / grain : par_workers() * PAR_CHUNKS_PER_WORKER;
+
+	if (job->chunks > len)
+		job->chunks = len;
+
+	job->claims = job->chunks;
+}
+
+// chunks differ in length by at most one
+static void par_chunk(par_job_t* job, size_t chunk, size_t* begin, size_t* end) {
+	size_t len = job->end - job->begin;
+	size_t step = len / job->chunks;
+	size_t extra = len % job->chunks;
+
+	*begin = job->begin + chunk * step + (chunk < extra ? chunk : extra);
+	*end = *begin + step + (chunk < extra ? 1 : 0);
+}
+
+static void par_run_for(par_job_t* job, size_t claim) {
+	size_t begin, end;
+	par_chunk(job, claim, &begin, &end);
+	job->body(begin, end, job->arg);
+}
+
+static void par_run_map(par_job_t* job, size_t claim) {
+	size_t begin, end;
+	par_chunk(job, claim, &begin, &end);
+
+	for (size_t i = begin; i < end; ++i)
+		job->map(i, job->out + (i - job->begin) * job->size, job->arg);
+}
+
+static char* par_node(par_job_t* job, size_t node) {
+	return job->nodes + node * job->size;
+}
+
+// the second child to arrive combines the pair and carries on up the tree
+static void par_run_reduce(par_job_t* job, size_t claim) {
+	size_t node = job->leaves + claim;
+
+	if (claim < job->chunks) {
+		size_t begin, end;
+		par_chunk(job, claim, &begin, &end);
+		job->leaf(begin, end, par_node(job, node), job->arg);
+		job->filled[node] = true;
+	}
+
+	while (node > 1) {
+		size_t parent = node / 2;
+		size_t left = 2 * parent;
+		size_t right = left + 1;
+
+		if (++job->arrived[parent] == 1)
+			return;
+
+		if (job->filled[left] && job->filled[right])
+			job->combine(par_node(job, left), par_node(job, right), job->arg);
+
+		if (job->filled[left] || job->filled[right]) {
+			memcpy(par_node(job, parent), par_node(job, job->filled[left] ? left : right), job->size);
+			job->filled[parent] = true;
+		}
+
+		node = parent;
+	}
+}
+
+static void par_hello(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)stateptr;
+	(void)nbytes;
+	(void)data;
+
+	if (ctx->sender != ACTOR_ID_NONE && ctx_send(ctx, ctx->sender, par_message(PAR_READY, NULL)) != 0)
+		exit(-2);
+}
+
+static void par_root_start(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+static void par_root_ready(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+static void par_worker_work(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+static void par_helper_hello(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+static void par_helper_work(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+
+static act_ctx_t par_root_prompts[] = {par_hello, par_root_start, par_root_ready};
+static role_ctx_t par_root_role = {3, par_root_prompts};
+
+static act_ctx_t par_worker_prompts[] = {par_hello, par_worker_work};
+static role_ctx_t par_worker_role = {2, par_worker_prompts};
+
+static act_ctx_t par_helper_prompts[] = {par_helper_hello, par_helper_work};
+static role_ctx_t par_helper_role = {2, par_helper_prompts};
+
+static void par_root_start(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)nbytes;
+
+	par_root_t* root = malloc(sizeof(par_root_t));
+
+	if (root == NULL)
+		exit(-1);
+
+	root->job = (par_job_t*)data;
+	root->ready = 0;
+	*stateptr = root;
+
+	for (size_t i = 0; i < root->job->actors; ++i) {
+		message_t spawn;
+		spawn.message_type = MSG_SPAWN_CTX;
+		spawn.nbytes = sizeof(role_ctx_t);
+		spawn.data = &par_worker_role;
+
+		if (ctx_send(ctx, ctx->self, spawn) != 0)
+			exit(-2);
+	}
+}
+
+// every worker reports in once and gets the job back
+static void par_root_ready(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)nbytes;
+	(void)data;
+
+	par_root_t* root = (par_root_t*)*stateptr;
+
+	if (ctx_reply(ctx, par_message(PAR_WORK, root->job)) != 0)
+		exit(-2);
+
+	if (++root->ready == root->job->actors) {
+		free(root);
+		*stateptr = NULL;
+
+		if (ctx_send(ctx, ctx->self, par_message(MSG_GODIE, NULL)) != 0)
+			exit(-2);
+	}
+}
+
+static void par_worker_work(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)stateptr;
+	(void)nbytes;
+
+	par_job_t* job = (par_job_t*)data;
+	size_t claim = job->next_claim++;
+
+	if (claim >= job->claims) {
+		if (ctx_send(ctx, ctx->self, par_message(MSG_GODIE, NULL)) != 0)
+			exit(-2);
+		return;
+	}
+
+	job->run(job, claim);
+
+	if (ctx_send(ctx, ctx->self, par_message(PAR_WORK, job)) != 0)
+		exit(-2);
+}
+
+// helpers are created by whoever calls, so their hello answers nobody
+static void par_helper_hello(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)ctx;
+	(void)stateptr;
+	(void)nbytes;
+	(void)data;
+}
+
+// a helper takes its ticket, or the caller cancels it once it did all the work;
+// whoever lets go of it last frees it
+#define PAR_ASKED		0
+#define PAR_TAKEN		1
+#define PAR_CANCELLED	2
+
+typedef struct par_ticket {
+	_Atomic int state;
+	_Atomic int refs;
+	par_job_t* job;
+} par_ticket_t;
+
+static void par_ticket_release(par_ticket_t* ticket) {
+	if (--ticket->refs == 0)
+		free(ticket);
+}
+
+// in a running system: a helper that gets to its ticket in time takes claims until
+// none is left, all in this one turn, so whoever waits for it waits for a worker
+// that is running it
+static void par_helper_work(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)stateptr;
+	(void)nbytes;
+
+	par_ticket_t* ticket = (par_ticket_t*)data;
+	int asked = PAR_ASKED;
+
+	if (atomic_compare_exchange_strong(&(ticket->state), &asked, PAR_TAKEN)) {
+		par_job_t* job = ticket->job;
+
+		for (size_t claim; (claim = job->next_claim++) < job->claims; )
+			job->run(job, claim);
+	}
+
+	par_ticket_release(ticket);
+
+	if (ctx_reply(ctx, par_message(PAR_WORK, NULL)) != 0)
+		exit(-2);
+}
+
+// the caller takes claims as well, and is one of the workers when it is a handler;
+// it only waits for the helpers that took their ticket, so calls nested in the
+// work never wait for a helper that needs a worker they all hold
+static int par_run_live(par_job_t* job) {
+	int live = actor_pool_workers();
+	size_t workers = live > 0 ? (size_t)live : 1;
+	size_t helpers = (job->claims < workers ? job->claims : workers) - 1;
+	future_t* futures = helpers > 0 ? malloc(sizeof(future_t) * helpers) : NULL;
+	par_ticket_t** tickets = helpers > 0 ? calloc(helpers, sizeof(par_ticket_t*)) : NULL;
+	actor_id_t group;
+	int check = 0;
+
+	if (helpers > 0) {
+		actor_group_config_t config = {ACTOR_GROUP_ROUND_ROBIN, helpers, NULL};
+
+		if (futures == NULL || tickets == NULL || actor_group_create(&group, &par_helper_role, &config) != 0) {
+			free(futures);
+			free(tickets);
+			futures = NULL;
+			tickets = NULL;
+			helpers = 0;
+			check = -1;
+		}
+	}
+
+	size_t asked = 0;
+
+	for (; asked < helpers && check == 0; ++asked) {
+		par_ticket_t* ticket = malloc(sizeof(par_ticket_t));
+
+		if (ticket == NULL) {
+			check = -1;
+			break;
+		}
+
+		ticket->state = PAR_ASKED;
+		ticket->refs = 2;
+		ticket->job = job;
+
+		message_t msg;
+		msg.message_type = PAR_WORK;
+		msg.nbytes = sizeof(par_ticket_t);
+		msg.data = ticket;
+
+		if (ask(group, msg, &(futures[asked])) != 0) {
+			free(ticket);
+			check = -1;
+			break;
+		}
+
+		tickets[asked] = ticket;
+	}
+
+	// whatever the helpers do not get to is done here
+	for (size_t claim; (claim = job->next_claim++) < job->claims; )
+		job->run(job, claim);
+
+	for (size_t i = 0; i < asked; ++i) {
+		int state = PAR_ASKED;
+		message_t reply;
+
+		if (!atomic_compare_exchange_strong(&(tickets[i]->state), &state, PAR_CANCELLED)
+				&& future_wait(&(futures[i]), &reply) != FUTURE_SUCCESS)
+			check = -1;
+
+		future_destroy(&(futures[i]));
+		par_ticket_release(tickets[i]);
+	}
+
+	if (helpers > 0 && send_message(group, par_message(MSG_GODIE, NULL)) != 0)
+		check = -1;
+
+	free(futures);
+	free(tickets);
+	return check;
+}
+
+static int par_run(par_job_t* job) {
+	job->next_claim = 0;
+
+	if (actor_system_running())
+		return par_run_live(job);
+
+	size_t workers = par_workers();
+	job->actors = job->claims < workers ? job->claims : workers;
+
+	actor_id_t root;
+
+	if (actor_system_create_ctx(&root, &par_root_role) != 0)
+		return -1;
+
+	// the system is torn down either way
+	int check = send_message(root, par_message(PAR_START, job));
+
+	if (check != 0)
+		actor_system_shutdown();
+
+	actor_system_join(root);
+	return check;
+}
+
+static void par_job_init(par_job_t* job, size_t begin, size_t end, size_t grain, void* arg) {
+	memset(job, 0, sizeof(par_job_t));
+	job->begin = begin;
+	job->end = end;
+	job->arg = arg;
+	par_split(job, end - begin, grain);
+}
+
+int actor_parallel_for(size_t begin, size_t end, size_t grain, par_for_t body, void* arg) {
+	if (begin >= end)
+		return 0;
+
+	par_job_t job;
+	par_job_init(&job, begin, end, grain, arg);
+	job.run = par_run_for;
+	job.body = body;
+
+	return par_run(&job);
+}
+
+int actor_map(size_t begin, size_t end, size_t grain, size_t size, void* out, par_map_t f, void* arg) {
+	if (begin >= end)
+		return 0;
+
+	par_job_t job;
+	par_job_init(&job, begin, end, grain, arg);
+	job.run = par_run_map;
+	job.map = f;
+	job.size = size;
+	job.out = (char*)out;
+
+	return par_run(&job);
+}
+
+int actor_reduce(size_t begin, size_t end, size_t grain, size_t size, void* out,
+		par_leaf_t leaf, par_combine_t combine, void* arg) {
+	if (begin >= end)
+		return 0;
+
+	par_job_t job;
+	par_job_init(&job, begin, end, grain, arg);
+	job.run = par_run_reduce;
+	job.leaf = leaf;
+	job.combine = combine;
+	job.size = size;
+
+	job.leaves = 1;
+
+	while (job.leaves < job.chunks)
+		job.leaves *= 2;
+
+	job.claims = job.leaves;
+	job.nodes = malloc(2 * job.leaves * size);
+	job.filled = calloc(2 * job.leaves, sizeof(bool));
+	job.arrived = calloc(job.leaves, sizeof(_Atomic int));
+
+	if (job.nodes == NULL || job.filled == NULL || job.arrived == NULL) {
+		free(job.nodes);
+		free(job.filled);
+		free(job.arrived);
+		return -1;
+	}
+
+	int check = par_run(&job);
+
+	if (check == 0 && job.filled[1])
+		memcpy(out, par_node(&job, 1), size);
+
+	free(job.nodes);
+	free(job.filled);
+	free(job.arrived);
+
+	return check;
+}
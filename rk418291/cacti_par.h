@@ -0,0 +1,33 @@
+#ifndef CACTI_PAR_H
+#define CACTI_PAR_H
+
+#include "cacti.h"
+
+// Data-parallel helpers over [begin, end); each call returns once all the work is
+// done. While a system is running, from a handler of it or from outside, the work
+// goes to a group of actors of that system and the caller takes chunks as well;
+// otherwise the call runs a system of its own. grain is the chunk length; 0 picks
+// a few chunks per worker.
+
+typedef void (*par_for_t)(size_t begin, size_t end, void *arg);
+
+typedef void (*par_map_t)(size_t i, void *out, void *arg);
+
+// Computes the value of the chunk [begin, end) into value.
+typedef void (*par_leaf_t)(size_t begin, size_t end, void *value, void *arg);
+
+// acc = acc (+) other, where acc covers the indices right before other's;
+// other is not used again, so anything it owns may be moved or freed.
+typedef void (*par_combine_t)(void *acc, void *other, void *arg);
+
+int actor_parallel_for(size_t begin, size_t end, size_t grain, par_for_t body, void *arg);
+
+// out[i - begin] = f(i), each element size bytes long.
+int actor_map(size_t begin, size_t end, size_t grain, size_t size, void *out, par_map_t f, void *arg);
+
+// Combines the chunk values in index order along a balanced tree into out;
+// out is left alone when the range is empty.
+int actor_reduce(size_t begin, size_t end, size_t grain, size_t size, void *out,
+                 par_leaf_t leaf, par_combine_t combine, void *arg);
+
+#endif
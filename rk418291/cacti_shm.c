@@ -0,0 +1,390 @@
+#include "cacti_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_MAGIC	0x326d736974636163ULL
+
+// the name slot is free, being written, or published
+#define SHM_NAME_FREE	0
+#define SHM_NAME_BUSY	1
+#define SHM_NAME_READY	2
+
+// how long a sender waits on a full ring before giving up
+#define SHM_FULL_TRIES	100000
+// empty polls before the receiver goes to sleep until a sender rings
+#define SHM_SPIN	4096
+// how often a message waiting for room in a mailbox is offered again
+#define SHM_HELD_MS	1
+// how long an opener waits for the creator to set the segment up
+#define SHM_OPEN_TRIES	1000
+
+typedef struct shm_name {
+	_Atomic int state;
+	char name[ACTOR_SHM_NAME_LENGTH];
+	_Atomic actor_id_t actor;
+} shm_name_t;
+
+// a cell is free for the producer at position pos when seq == pos, and holds
+// the message of position pos when seq == pos + 1
+typedef struct shm_cell {
+	_Atomic uint64_t seq;
+	actor_id_t target;
+	actor_id_t sender;
+	message_type_t type;
+	size_t nbytes;
+	unsigned char data[ACTOR_SHM_PAYLOAD];
+} shm_cell_t;
+
+// what shm_take found at the head of the ring
+#define SHM_TAKEN	0
+#define SHM_EMPTY	1
+#define SHM_HELD	2
+
+// many producers, the node's receiver as the only consumer
+typedef struct shm_ring {
+	_Alignas(64) _Atomic uint64_t tail;
+	_Alignas(64) uint64_t head;
+	// the receiver waits on bell while sleeping is set, senders ring it then
+	_Alignas(64) _Atomic uint32_t bell;
+	_Atomic uint32_t sleeping;
+	_Alignas(64) shm_cell_t cells[ACTOR_SHM_SLOTS];
+} shm_ring_t;
+
+typedef struct shm_segment {
+	uint64_t magic;
+	uint32_t nodes;
+	uint32_t slots;
+	uint32_t payload;
+	_Atomic int ready;
+	shm_name_t names[ACTOR_SHM_NAMES];
+	shm_ring_t rings[ACTOR_SHM_NODES];
+} shm_segment_t;
+
+static shm_segment_t* segment = NULL;
+static int shm_node;
+static pthread_t receiver;
+static _Atomic bool stopping;
+static _Atomic size_t dropped;
+
+// the futex word lives in the shared segment, so it is not a private futex
+static void shm_wait(_Atomic uint32_t* bell, uint32_t rung, long timeout_ms) {
+	struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+
+	syscall(SYS_futex, (uint32_t*)bell, FUTEX_WAIT, rung, timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+}
+
+static void shm_ring_bell(shm_ring_t* r) {
+	atomic_fetch_add(&(r->bell), 1);
+	syscall(SYS_futex, (uint32_t*)&(r->bell), FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static int shm_send(void* self, int node, actor_id_t target, actor_id_t sender, message_t msg) {
+	(void)self;
+
+	if (node >= ACTOR_SHM_NODES || msg.nbytes > ACTOR_SHM_PAYLOAD || (msg.nbytes > 0 && msg.data == NULL))
+		return -1;
+
+	shm_ring_t* r = &(segment->rings[node]);
+	uint64_t pos = atomic_load_explicit(&(r->tail), memory_order_relaxed);
+	shm_cell_t* cell;
+	int tries = 0;
+
+	while (true) {
+		cell = &(r->cells[pos % ACTOR_SHM_SLOTS]);
+		int64_t diff = (int64_t)(atomic_load_explicit(&(cell->seq), memory_order_acquire) - pos);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&(r->tail), &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else {
+			// full: the receiver is a lap behind
+			if (diff < 0) {
+				if (++tries > SHM_FULL_TRIES)
+					return -1;
+				sched_yield();
+			}
+			pos = atomic_load_explicit(&(r->tail), memory_order_relaxed);
+		}
+	}
+
+	cell->target = target;
+	cell->sender = sender;
+	cell->type = msg.message_type;
+	cell->nbytes = msg.nbytes;
+	if (msg.nbytes > 0)
+		memcpy(cell->data, msg.data, msg.nbytes);
+
+	atomic_store_explicit(&(cell->seq), pos + 1, memory_order_release);
+
+	// pairs with the receiver's fence: either it sees the message or this sees it asleep
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&(r->sleeping), memory_order_relaxed))
+		shm_ring_bell(r);
+
+	return 0;
+}
+
+static actor_transport_t const shm_transport = {shm_send, NULL};
+
+// moves one message from this node's ring into the actor system; one whose target's
+// mailbox is full stays at the head, and the senders wait for room in the ring
+static int shm_take() {
+	shm_ring_t* r = &(segment->rings[shm_node]);
+	shm_cell_t* cell = &(r->cells[r->head % ACTOR_SHM_SLOTS]);
+
+	if (atomic_load_explicit(&(cell->seq), memory_order_acquire) != r->head + 1)
+		return SHM_EMPTY;
+
+	// other processes write the cell, so its length is read once and checked like
+	// shm_send does; a cell that does not fit is dropped
+	size_t nbytes = cell->nbytes;
+	actor_buffer_t* buffer = nbytes <= ACTOR_SHM_PAYLOAD ? buffer_create(nbytes) : NULL;
+
+	if (buffer != NULL) {
+		memcpy(buffer_data(buffer), cell->data, nbytes);
+
+		int ret = actor_node_deliver(cell->target, cell->sender, cell->type, buffer);
+		buffer_release(buffer);
+
+		if (ret == ACTOR_NODE_FULL)
+			return SHM_HELD;
+
+		if (ret != 0)
+			++dropped;
+	}
+	else {
+		++dropped;
+	}
+
+	atomic_store_explicit(&(cell->seq), r->head + ACTOR_SHM_SLOTS, memory_order_release);
+	++(r->head);
+	return SHM_TAKEN;
+}
+
+static void* shm_receive(void* arg) {
+	(void)arg;
+	shm_ring_t* r = &(segment->rings[shm_node]);
+	long idle = 0;
+
+	while (!stopping) {
+		int took = shm_take();
+
+		// spins while messages keep coming
+		if (took == SHM_TAKEN || (took == SHM_EMPTY && ++idle < SHM_SPIN)) {
+			if (took == SHM_TAKEN)
+				idle = 0;
+			continue;
+		}
+
+		uint32_t rung = atomic_load(&(r->bell));
+		atomic_store_explicit(&(r->sleeping), 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		// a message published before sleeping was set is found here, later ones ring;
+		// a held one is offered again after SHM_HELD_MS, as the mailbox empties unrung
+		shm_cell_t* cell = &(r->cells[r->head % ACTOR_SHM_SLOTS]);
+		bool empty = atomic_load_explicit(&(cell->seq), memory_order_acquire) != r->head + 1;
+
+		if (!stopping && (took == SHM_HELD || empty))
+			shm_wait(&(r->bell), rung, took == SHM_HELD ? SHM_HELD_MS : -1);
+
+		atomic_store_explicit(&(r->sleeping), 0, memory_order_relaxed);
+		idle = 0;
+	}
+
+	return NULL;
+}
+
+static void shm_init(shm_segment_t* seg) {
+	seg->magic = SHM_MAGIC;
+	seg->nodes = ACTOR_SHM_NODES;
+	seg->slots = ACTOR_SHM_SLOTS;
+	seg->payload = ACTOR_SHM_PAYLOAD;
+
+	for (int n = 0; n < ACTOR_SHM_NODES; ++n) {
+		for (uint64_t i = 0; i < ACTOR_SHM_SLOTS; ++i)
+			atomic_init(&(seg->rings[n].cells[i].seq), i);
+	}
+
+	atomic_store_explicit(&(seg->ready), 1, memory_order_release);
+}
+
+// whoever creates the segment sets it up, the others wait until it is ready
+static shm_segment_t* shm_map(char const* name) {
+	bool created = true;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name, O_RDWR, 0600);
+	}
+
+	if (fd < 0)
+		return NULL;
+
+	if (created && ftruncate(fd, sizeof(shm_segment_t)) != 0) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	struct stat st;
+	int tries = 0;
+
+	while (!created && (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shm_segment_t))) {
+		if (++tries > SHM_OPEN_TRIES) {
+			close(fd);
+			return NULL;
+		}
+		usleep(1000);
+	}
+
+	shm_segment_t* seg = (shm_segment_t*)mmap(NULL, sizeof(shm_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (seg == MAP_FAILED)
+		return NULL;
+
+	if (created)
+		shm_init(seg);
+
+	for (tries = 0; atomic_load_explicit(&(seg->ready), memory_order_acquire) == 0; ++tries) {
+		if (tries > SHM_OPEN_TRIES) {
+			munmap(seg, sizeof(shm_segment_t));
+			return NULL;
+		}
+		usleep(1000);
+	}
+
+	if (seg->magic != SHM_MAGIC || seg->nodes != ACTOR_SHM_NODES
+			|| seg->slots != ACTOR_SHM_SLOTS || seg->payload != ACTOR_SHM_PAYLOAD) {
+		munmap(seg, sizeof(shm_segment_t));
+		return NULL;
+	}
+
+	return seg;
+}
+
+int actor_shm_attach(char const* name, int node) {
+	if (segment != NULL || node < 0 || node >= ACTOR_SHM_NODES)
+		return -1;
+
+	shm_segment_t* seg = shm_map(name);
+	if (seg == NULL)
+		return -1;
+
+	segment = seg;
+	shm_node = node;
+	stopping = false;
+	dropped = 0;
+
+	if (pthread_create(&receiver, NULL, shm_receive, NULL) != 0) {
+		munmap(seg, sizeof(shm_segment_t));
+		segment = NULL;
+		return -1;
+	}
+
+	actor_node_set_self(node);
+
+	for (int n = 0; n < ACTOR_SHM_NODES; ++n) {
+		if (n != node)
+			actor_node_route(n, &shm_transport);
+	}
+
+	return 0;
+}
+
+int actor_shm_detach() {
+	if (segment == NULL)
+		return -1;
+
+	for (int n = 0; n < ACTOR_SHM_NODES; ++n)
+		actor_node_route(n, NULL);
+
+	// a sender that found a route may still be writing into the segment
+	actor_node_settle();
+	actor_node_set_self(-1);
+
+	stopping = true;
+	shm_ring_bell(&(segment->rings[shm_node]));
+
+	if (pthread_join(receiver, NULL) != 0)
+		exit(-1);
+
+	munmap(segment, sizeof(shm_segment_t));
+	segment = NULL;
+	return 0;
+}
+
+int actor_shm_unlink(char const* name) {
+	return shm_unlink(name) == 0 ? 0 : -1;
+}
+
+static shm_name_t* shm_find(char const* name) {
+	for (size_t i = 0; i < ACTOR_SHM_NAMES; ++i) {
+		shm_name_t* entry = &(segment->names[i]);
+
+		if (atomic_load_explicit(&(entry->state), memory_order_acquire) == SHM_NAME_READY
+				&& strncmp(entry->name, name, ACTOR_SHM_NAME_LENGTH) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+int actor_shm_register(char const* name, actor_id_t actor) {
+	if (segment == NULL || strlen(name) >= ACTOR_SHM_NAME_LENGTH || actor < 0)
+		return -1;
+
+	if (actor_node_of(actor) < 0)
+		actor = actor_node_id(shm_node, actor);
+
+	shm_name_t* entry = shm_find(name);
+
+	if (entry != NULL) {
+		entry->actor = actor;
+		return 0;
+	}
+
+	for (size_t i = 0; i < ACTOR_SHM_NAMES; ++i) {
+		entry = &(segment->names[i]);
+		int expected = SHM_NAME_FREE;
+
+		if (atomic_compare_exchange_strong(&(entry->state), &expected, SHM_NAME_BUSY)) {
+			strcpy(entry->name, name);
+			entry->actor = actor;
+			atomic_store_explicit(&(entry->state), SHM_NAME_READY, memory_order_release);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int actor_shm_lookup(char const* name, actor_id_t* actor) {
+	if (segment == NULL)
+		return -1;
+
+	shm_name_t* entry = shm_find(name);
+
+	if (entry == NULL)
+		return -1;
+
+	*actor = entry->actor;
+	return 0;
+}
+
+size_t actor_shm_dropped() {
+	return dropped;
+}
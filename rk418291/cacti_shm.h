@@ -0,0 +1,48 @@
+#ifndef CACTI_SHM_H
+#define CACTI_SHM_H
+
+#include "cacti_node.h"
+
+// Processes of one host attached to the same POSIX shared memory segment reach
+// each other's actors through it: every node has a ring in the segment that the
+// others copy messages into, without syscalls unless the ring stays full or its
+// receiver went to sleep after finding it empty for a while.
+
+#ifndef ACTOR_SHM_NODES
+#define ACTOR_SHM_NODES 16
+#endif
+
+#ifndef ACTOR_SHM_SLOTS
+#define ACTOR_SHM_SLOTS 1024
+#endif
+
+// Largest payload a message to another process may carry.
+#ifndef ACTOR_SHM_PAYLOAD
+#define ACTOR_SHM_PAYLOAD 216
+#endif
+
+#define ACTOR_SHM_NAMES 256
+#define ACTOR_SHM_NAME_LENGTH 48
+
+// Opens the segment, creating it if no process did yet, and joins it as node,
+// which becomes the node of this process. Messages arriving in the ring are
+// handed to the actor system running at the time; without one they are dropped.
+int actor_shm_attach(char const *segment, int node);
+
+// Stops taking messages from this node's ring and leaves the segment once sends
+// into it that are under way returned.
+int actor_shm_detach();
+
+// Removes the segment name; attached processes keep their mapping.
+int actor_shm_unlink(char const *segment);
+
+// Publishes a local actor under name for the other processes of the segment.
+int actor_shm_register(char const *name, actor_id_t actor);
+
+// The global id published under name; -1 if there is none yet.
+int actor_shm_lookup(char const *name, actor_id_t *actor);
+
+// Messages that arrived for actors or systems that were gone.
+size_t actor_shm_dropped();
+
+#endif
@@ -1,9 +1,9 @@
 #include "cacti.h"
+#include "macierz.h"
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
-typedef long long num_t;
-
 #define MSG_SUM 	(message_type_t)1
 #define MSG_SEND	(message_type_t)2
 
@@ -29,22 +29,6 @@ message_t message_hello(size_t nbytes, void* data) {
 	return msg;
 }
 
-message_t message_sum(size_t nbytes, void* data) {
-	message_t msg;
-	msg.message_type = MSG_SUM;
-	msg.nbytes = nbytes;
-	msg.data = data;
-	return msg;
-}
-
-message_t message_send(size_t nbytes, void* data) {
-	message_t msg;
-	msg.message_type = MSG_SEND;
-	msg.nbytes = nbytes;
-	msg.data = data;
-	return msg;
-}
-
 
 void hello(void** stateptr, size_t nbytes, void* data) {
 	(void)nbytes;
@@ -70,6 +54,8 @@ static actor_id_t convert_my_col(actor_id_t my_row, actor_id_t my_col) {
 }
 
 void sum(void **stateptr, size_t nbytes, void *data) {
+	(void)nbytes;
+
 	actor_id_t* my_col = (actor_id_t*)(*stateptr);
 	actor_id_t* my_row = (actor_id_t*)(*stateptr + 1);
 	actor_id_t conv_col = convert_my_col(*my_row, *my_col);
@@ -97,7 +83,7 @@ void sum(void **stateptr, size_t nbytes, void *data) {
 	*result = *result + value;
 
 	if (conv_col != *n - 1) {
-		if (send_message(actor_id_self(), message_send(nbytes, data)) != 0)
+		if (send_buffer(actor_id_self(), MSG_SEND, buffer_of(data)) != 0)
 			exit(-2);
 	}
 
@@ -109,15 +95,16 @@ void sum(void **stateptr, size_t nbytes, void *data) {
 			exit(-2);
 	}
 	else if (conv_col == 0) {
-		if (send_message(actor_id_self(), message_sum(nbytes, data)) != 0)
+		if (send_buffer(actor_id_self(), MSG_SUM, buffer_of(data)) != 0)
 			exit(-2);
 	}
 }
 
 void send(void** stateptr, size_t nbytes, void* data) {
 	(void)stateptr;
+	(void)nbytes;
 
-	if (send_message(actor_id_self() + 1, message_sum(nbytes, data)) != 0) {
+	if (send_buffer(actor_id_self() + 1, MSG_SUM, buffer_of(data)) != 0) {
 		exit(-2);
 	}
 }
@@ -125,9 +112,63 @@ void send(void** stateptr, size_t nbytes, void* data) {
 
 typedef void (* act_t2)(void** stateptr, size_t nbytes, void* data);
 
-int main() {
-	num_t k, n; // k - no of rows, n - no of columns
-	scanf("%lld %lld", &k, &n);
+int main(int argc, char** argv) {
+	bool tiled = false;
+	bool fast = false;
+	bool to_binary = false;
+	bool stream = false;
+	int jobs = 1;
+	num_t window = 64;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--tiled") == 0)
+			tiled = true;
+		else if (strcmp(argv[i], "--fast") == 0)
+			fast = true;
+		else if (strcmp(argv[i], "--to-binary") == 0)
+			to_binary = fast = true;
+		else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+			jobs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--stream") == 0)
+			stream = true;
+		else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc)
+			window = atoll(argv[++i]);
+		else
+			exit(-1);
+	}
+
+	if (stream)
+		return macierz_stream(stdin, window) == 0 ? 0 : -1;
+
+	macierz_input_t in;
+
+	if (fast) {
+		if (macierz_input_read(STDIN_FILENO, jobs, &in) != 0)
+			exit(-1);
+	}
+	else {
+		in.base = NULL;
+		scanf("%lld %lld", &in.k, &in.n);
+
+		in.values = (num_t*)malloc(sizeof(num_t) * in.k * in.n);
+		in.times = (num_t*)malloc(sizeof(num_t) * in.k * in.n);
+
+		for (num_t row = 0; row < in.k; ++row) {
+			for (num_t col = 0; col < in.n; ++col) {
+				scanf("%lld %lld", in.values + row * in.n + col, in.times + row * in.n + col);
+			}
+		}
+	}
+
+	if (to_binary) {
+		int check = macierz_input_write_binary(stdout, &in);
+		macierz_input_release(&in);
+		return check == 0 ? 0 : -1;
+	}
+
+	num_t k = in.k, n = in.n; // k - no of rows, n - no of columns
+	num_t* values = in.values;
+	num_t* times = in.times;
 
 	role_t role;
 	role.nprompts = 3;
@@ -137,22 +178,34 @@ int main() {
 	*(acts + 2) = (act_t2)send;
 	role.prompts = (act_t*)acts;
 
-	num_t* values = (num_t*)malloc(sizeof(num_t) * k * n);
-	num_t* times = (num_t*)malloc(sizeof(num_t) * k * n);
 	num_t* sums = (num_t*)malloc(sizeof(num_t) * k);
 
 	for (num_t row = 0; row < k; ++row) {
-		for (num_t col = 0; col < n; ++col) {
-			scanf("%lld %lld", values + row * n + col, times + row * n + col);
-		}
+		*(sums + row) = 0;
 	}
 
-	for (num_t row = 0; row < k; ++row) {
-		*(sums + row) = 0;
+	if (tiled) {
+		if (macierz_tiled(k, n, values, times, sums) != 0)
+			exit(-1);
+
+		for (num_t i = 0; i < k; ++i) {
+			printf("%lld\n", *(sums + i));
+		}
+
+		free(acts);
+		macierz_input_release(&in);
+		free(sums);
+
+		return 0;
 	}
 
-	size_t nbytes = sizeof(num_t) * 2 + sizeof(num_t) * k * n * 2 + sizeof(role_t) + sizeof(num_t) * k;
-	void** data = (void**)malloc(nbytes);
+	// every column shares this one block; the last message to let go of it frees it
+	actor_buffer_t* shared = buffer_create(sizeof(void*) * 6);
+
+	if (shared == NULL)
+		exit(-1);
+
+	void** data = (void**)buffer_data(shared);
 	*data = &k;
 	*(data + 1) = &n;
 	*(data + 2) = values;
@@ -172,7 +225,7 @@ int main() {
 	if (check != 0)
 		exit(check);
 	
-	check = send_message(a, message_sum(nbytes, (void*)data));
+	check = send_buffer(a, MSG_SUM, shared);
 	
 	if (check != 0)
 		exit(check);
@@ -183,10 +236,9 @@ int main() {
 	}
 
 	free(acts);
-	free(values);
-	free(times);
+	macierz_input_release(&in);
 	free(sums);
-	free(data);
+	buffer_release(shared);
 
 	return 0;
 }
@@ -0,0 +1,39 @@
+#ifndef MACIERZ_H
+#define MACIERZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef long long num_t;
+
+// binary input: the magic, k and n, then k * n values and k * n times, all native num_t
+#define MACIERZ_MAGIC "MACIERZ1"
+
+typedef struct macierz_input {
+    num_t k;
+    num_t n;
+    num_t* values;
+    num_t* times;
+
+    // when set, values and times point into this buffer instead of owning memory
+    void* base;
+    size_t len;
+    bool mapped;
+} macierz_input_t;
+
+// maps or block-reads fd and parses it with up to jobs threads; binary input is used in place
+int macierz_input_read(int fd, int jobs, macierz_input_t* in);
+
+int macierz_input_write_binary(FILE* out, const macierz_input_t* in);
+
+void macierz_input_release(macierz_input_t* in);
+
+// sums the rows of a k x n matrix with tile actors instead of one actor per column
+int macierz_tiled(num_t k, num_t n, num_t* values, num_t* times, num_t* sums);
+
+// reads the matrix row by row and prints each sum as soon as the rows before it are done;
+// at most window rows are held at once
+int macierz_stream(FILE* in, num_t window);
+
+#endif
@@ -0,0 +1,345 @@
+#include "macierz.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BLOCK	(1 << 20)
+#define HEADER_LEN	(sizeof(MACIERZ_MAGIC) - 1 + 2 * sizeof(num_t))
+
+typedef struct parse_chunk {
+	const char* begin;
+	const char* end;
+	num_t first; // index of the first number in the chunk
+	num_t count;
+	num_t* values;
+	num_t* times;
+	int error;
+} parse_chunk_t;
+
+static bool is_space(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+// reads one integer at *p, skipping whitespace before it
+static int scan_num(const char** p, const char* end, num_t* out) {
+	const char* s = *p;
+
+	while (s < end && is_space(*s))
+		++s;
+
+	bool negative = s < end && *s == '-';
+
+	if (negative)
+		++s;
+
+	if (s == end || *s < '0' || *s > '9')
+		return -1;
+
+	unsigned long long v = 0;
+
+	while (s < end && *s >= '0' && *s <= '9')
+		v = v * 10 + (unsigned long long)(*s++ - '0');
+
+	*out = negative ? -(num_t)v : (num_t)v;
+	*p = s;
+	return 0;
+}
+
+// first pass: how many numbers does the chunk hold
+static void *chunk_count(void* arg) {
+	parse_chunk_t* c = (parse_chunk_t*)arg;
+	bool in_token = false;
+
+	c->count = 0;
+
+	for (const char* s = c->begin; s < c->end; ++s) {
+		bool space = is_space(*s);
+
+		if (!space && !in_token)
+			++c->count;
+
+		in_token = !space;
+	}
+
+	return NULL;
+}
+
+// second pass: numbers alternate between values and times, straight into place
+static void *chunk_parse(void* arg) {
+	parse_chunk_t* c = (parse_chunk_t*)arg;
+	const char* s = c->begin;
+
+	c->error = 0;
+
+	for (num_t i = c->first; i < c->first + c->count; ++i) {
+		num_t* dest = i % 2 == 0 ? c->values + i / 2 : c->times + i / 2;
+
+		if (scan_num(&s, c->end, dest) != 0) {
+			c->error = -1;
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+static int run_chunks(parse_chunk_t* chunks, int jobs, void* (*pass)(void*)) {
+	if (jobs == 1) {
+		pass(chunks);
+		return 0;
+	}
+
+	pthread_t* threads = malloc(sizeof(pthread_t) * jobs);
+
+	if (threads == NULL)
+		return -1;
+
+	for (int i = 0; i < jobs; ++i) {
+		if (pthread_create(threads + i, NULL, pass, chunks + i) != 0)
+			exit(-1);
+	}
+
+	for (int i = 0; i < jobs; ++i) {
+		if (pthread_join(threads[i], NULL) != 0)
+			exit(-1);
+	}
+
+	free(threads);
+	return 0;
+}
+
+static int parse_text(const char* text, size_t len, int jobs, macierz_input_t* in) {
+	const char* s = text;
+	const char* end = text + len;
+
+	if (scan_num(&s, end, &in->k) != 0 || scan_num(&s, end, &in->n) != 0)
+		return -1;
+
+	if (in->k < 0 || in->n < 0)
+		return -1;
+
+	// huge k and n must not wrap around to a small matrix
+	if (in->n > 0 && (size_t)in->k > SIZE_MAX / (2 * sizeof(num_t)) / (size_t)in->n)
+		return -1;
+
+	size_t cells = (size_t)in->k * (size_t)in->n;
+
+	in->values = malloc(sizeof(num_t) * (cells > 0 ? cells : 1));
+	in->times = malloc(sizeof(num_t) * (cells > 0 ? cells : 1));
+
+	if (in->values == NULL || in->times == NULL)
+		return -1;
+
+	if (jobs < 1)
+		jobs = 1;
+
+	// small inputs are not worth a thread each
+	if ((size_t)(end - s) < (size_t)jobs * READ_BLOCK)
+		jobs = (int)((end - s) / READ_BLOCK) + 1;
+
+	parse_chunk_t* chunks = malloc(sizeof(parse_chunk_t) * jobs);
+
+	if (chunks == NULL)
+		return -1;
+
+	// chunks are cut at line ends, so no number is split between two of them
+	const char* begin = s;
+
+	for (int i = 0; i < jobs; ++i) {
+		const char* cut = i == jobs - 1 ? end : begin + (end - begin) / (jobs - i);
+
+		while (cut < end && *cut != '\n')
+			++cut;
+
+		chunks[i].begin = begin;
+		chunks[i].end = cut;
+		chunks[i].values = in->values;
+		chunks[i].times = in->times;
+		begin = cut;
+	}
+
+	int err = run_chunks(chunks, jobs, chunk_count);
+
+	num_t first = 0;
+
+	for (int i = 0; i < jobs; ++i) {
+		chunks[i].first = first;
+		first += chunks[i].count;
+	}
+
+	if (err == 0 && (size_t)first != 2 * cells)
+		err = -1;
+
+	if (err == 0)
+		err = run_chunks(chunks, jobs, chunk_parse);
+
+	for (int i = 0; err == 0 && i < jobs; ++i)
+		err = chunks[i].error;
+
+	free(chunks);
+	return err;
+}
+
+// binary input is used in place: values and times point into the buffer
+static int load_binary(void* base, size_t len, macierz_input_t* in) {
+	if (len < HEADER_LEN)
+		return -1;
+
+	memcpy(&in->k, (char*)base + sizeof(MACIERZ_MAGIC) - 1, sizeof(num_t));
+	memcpy(&in->n, (char*)base + sizeof(MACIERZ_MAGIC) - 1 + sizeof(num_t), sizeof(num_t));
+
+	if (in->k < 0 || in->n < 0)
+		return -1;
+
+	// checked by division, so huge k and n cannot wrap around the length
+	if (in->n > 0 && (size_t)in->k > (len - HEADER_LEN) / (2 * sizeof(num_t)) / (size_t)in->n)
+		return -1;
+
+	size_t cells = (size_t)in->k * (size_t)in->n;
+
+	in->values = (num_t*)((char*)base + HEADER_LEN);
+	in->times = in->values + cells;
+	return 0;
+}
+
+static bool is_binary(const void* base, size_t len) {
+	return len >= sizeof(MACIERZ_MAGIC) - 1
+		&& memcmp(base, MACIERZ_MAGIC, sizeof(MACIERZ_MAGIC) - 1) == 0;
+}
+
+// pipes and terminals cannot be mapped, so they are read in big blocks
+static char* read_all(int fd, size_t* len) {
+	size_t cap = READ_BLOCK;
+	size_t used = 0;
+	char* buf = malloc(cap);
+
+	if (buf == NULL)
+		return NULL;
+
+	for (;;) {
+		if (cap - used < READ_BLOCK) {
+			char* bigger = realloc(buf, cap * 2);
+
+			if (bigger == NULL) {
+				free(buf);
+				return NULL;
+			}
+
+			buf = bigger;
+			cap *= 2;
+		}
+
+		ssize_t got = read(fd, buf + used, cap - used);
+
+		if (got < 0) {
+			free(buf);
+			return NULL;
+		}
+
+		if (got == 0)
+			break;
+
+		used += (size_t)got;
+	}
+
+	*len = used;
+	return buf;
+}
+
+int macierz_input_read(int fd, int jobs, macierz_input_t* in) {
+	struct stat st;
+	void* base;
+	size_t len;
+	bool mapped = false;
+
+	in->values = NULL;
+	in->times = NULL;
+	in->base = NULL;
+	in->len = 0;
+	in->mapped = false;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		len = (size_t)st.st_size;
+		base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (base == MAP_FAILED)
+			return -1;
+
+		madvise(base, len, MADV_SEQUENTIAL);
+		mapped = true;
+	}
+	else {
+		base = read_all(fd, &len);
+
+		if (base == NULL)
+			return -1;
+	}
+
+	in->base = base;
+	in->len = len;
+	in->mapped = mapped;
+
+	if (is_binary(base, len)) {
+		if (load_binary(base, len, in) != 0) {
+			macierz_input_release(in);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	int err = parse_text((const char*)base, len, jobs, in);
+
+	// the text is not needed once it has been parsed
+	if (mapped)
+		munmap(base, len);
+	else
+		free(base);
+
+	in->base = NULL;
+	in->len = 0;
+	in->mapped = false;
+
+	if (err != 0) {
+		macierz_input_release(in);
+		return -1;
+	}
+
+	return 0;
+}
+
+int macierz_input_write_binary(FILE* out, const macierz_input_t* in) {
+	size_t cells = (size_t)in->k * (size_t)in->n;
+
+	if (fwrite(MACIERZ_MAGIC, 1, sizeof(MACIERZ_MAGIC) - 1, out) != sizeof(MACIERZ_MAGIC) - 1
+		|| fwrite(&in->k, sizeof(num_t), 1, out) != 1
+		|| fwrite(&in->n, sizeof(num_t), 1, out) != 1
+		|| fwrite(in->values, sizeof(num_t), cells, out) != cells
+		|| fwrite(in->times, sizeof(num_t), cells, out) != cells)
+		return -1;
+
+	return 0;
+}
+
+void macierz_input_release(macierz_input_t* in) {
+	if (in->base == NULL) {
+		free(in->values);
+		free(in->times);
+	}
+	else if (in->mapped) {
+		munmap(in->base, in->len);
+	}
+	else {
+		free(in->base);
+	}
+
+	in->values = NULL;
+	in->times = NULL;
+	in->base = NULL;
+}
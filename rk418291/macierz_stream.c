@@ -0,0 +1,291 @@
+#include "cacti.h"
+#include "macierz.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_SETUP	(message_type_t)1
+#define MSG_ROW		(message_type_t)2
+#define MSG_DONE	(message_type_t)3
+
+typedef struct column_state {
+	actor_id_t self;
+	actor_id_t next; // ACTOR_ID_NONE for the last column
+	num_t index;
+} column_state_t;
+
+typedef struct column_setup {
+	actor_id_t next;
+	num_t index;
+} column_setup_t;
+
+// one row in flight: it travels down the columns and its sum is the reply
+typedef struct row_slot {
+	num_t* values;
+	num_t* times;
+	num_t sum;
+	future_t future;
+	bool busy;
+} row_slot_t;
+
+static message_t message_of(message_type_t type, size_t nbytes, void* data) {
+	message_t msg;
+	msg.message_type = type;
+	msg.nbytes = nbytes;
+	msg.data = data;
+	return msg;
+}
+
+static column_state_t* column_state(void** stateptr) {
+	if (*stateptr == NULL) {
+		column_state_t* state = malloc(sizeof(column_state_t));
+
+		if (state == NULL)
+			exit(-1);
+
+		state->next = ACTOR_ID_NONE;
+		state->index = 0;
+		*stateptr = state;
+	}
+
+	return (column_state_t*)*stateptr;
+}
+
+// a column spawned for an ask answers it with its id
+void column_hello(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)nbytes;
+	(void)data;
+
+	column_state_t* state = column_state(stateptr);
+	state->self = ctx->self;
+
+	// the first column is greeted by the system, not by an ask
+	if (ctx->sender == ACTOR_ID_NONE)
+		return;
+
+	if (ctx_reply(ctx, message_of(MSG_HELLO, sizeof(actor_id_t), &state->self)) != 0)
+		exit(-2);
+}
+
+void column_setup(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)ctx;
+	(void)nbytes;
+
+	column_state_t* state = column_state(stateptr);
+	column_setup_t* setup = (column_setup_t*)data;
+
+	state->next = setup->next;
+	state->index = setup->index;
+}
+
+void column_row(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	column_state_t* state = column_state(stateptr);
+	row_slot_t* row = (row_slot_t*)data;
+
+	if (row->times[state->index] > 0)
+		usleep(row->times[state->index] * 1000);
+	row->sum += row->values[state->index];
+
+	if (state->next == ACTOR_ID_NONE) {
+		if (ctx_reply(ctx, message_of(MSG_ROW, nbytes, data)) != 0)
+			exit(-2);
+	}
+	else if (ctx_forward(ctx, state->next, message_of(MSG_ROW, nbytes, data)) != 0) {
+		exit(-2);
+	}
+}
+
+void column_done(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)nbytes;
+	(void)data;
+
+	free(*stateptr);
+	*stateptr = NULL;
+
+	if (ctx_send(ctx, ctx->self, message_of(MSG_GODIE, 0, NULL)) != 0)
+		exit(-2);
+}
+
+// reads one integer from a stream that may be far larger than memory
+static int read_num(FILE* in, num_t* out) {
+	int c;
+
+	do {
+		c = getc_unlocked(in);
+	} while (c == ' ' || c == '\n' || c == '\t' || c == '\r');
+
+	bool negative = c == '-';
+
+	if (negative)
+		c = getc_unlocked(in);
+
+	if (c < '0' || c > '9')
+		return -1;
+
+	unsigned long long v = 0;
+
+	while (c >= '0' && c <= '9') {
+		v = v * 10 + (unsigned long long)(c - '0');
+		c = getc_unlocked(in);
+	}
+
+	*out = negative ? -(num_t)v : (num_t)v;
+	return 0;
+}
+
+static int row_finish(row_slot_t* row) {
+	message_t reply;
+
+	if (future_wait(&row->future, &reply) != FUTURE_SUCCESS)
+		return -1;
+
+	future_destroy(&row->future);
+	row->busy = false;
+
+	printf("%lld\n", row->sum);
+	return 0;
+}
+
+static void slots_destroy(row_slot_t* slots, num_t window) {
+	for (num_t i = 0; i < window; ++i) {
+		future_destroy(&slots[i].future);
+		free(slots[i].values);
+		free(slots[i].times);
+	}
+
+	free(slots);
+}
+
+static int columns_build(actor_id_t first, num_t n, actor_id_t* columns, role_ctx_t* role) {
+	future_t* spawned = malloc(sizeof(future_t) * n);
+
+	if (spawned == NULL)
+		return -1;
+
+	int err = 0;
+	num_t asked = 1;
+
+	columns[0] = first;
+
+	for (; asked < n && err == 0; ++asked) {
+		if (ask(first, message_of(MSG_SPAWN_CTX, sizeof(role_ctx_t), role), spawned + asked) != 0)
+			err = -1;
+	}
+
+	for (num_t c = 1; c < asked; ++c) {
+		message_t reply;
+
+		if (future_wait(spawned + c, &reply) == FUTURE_SUCCESS)
+			columns[c] = *(actor_id_t*)reply.data;
+		else
+			err = -1;
+
+		future_destroy(spawned + c);
+	}
+
+	free(spawned);
+	return err;
+}
+
+int macierz_stream(FILE* in, num_t window) {
+	num_t k, n;
+
+	if (read_num(in, &k) != 0 || read_num(in, &n) != 0 || k < 0 || n <= 0 || window <= 0)
+		return -1;
+
+	act_ctx_t prompts[] = {column_hello, column_setup, column_row, column_done};
+
+	role_ctx_t role;
+	role.nprompts = 4;
+	role.prompts = prompts;
+
+	actor_id_t* columns = malloc(sizeof(actor_id_t) * n);
+	column_setup_t* setups = malloc(sizeof(column_setup_t) * n);
+	row_slot_t* slots = calloc(window, sizeof(row_slot_t));
+
+	if (columns == NULL || setups == NULL || slots == NULL) {
+		free(columns);
+		free(setups);
+		free(slots);
+		return -1;
+	}
+
+	for (num_t i = 0; i < window; ++i) {
+		slots[i].values = malloc(sizeof(num_t) * n);
+		slots[i].times = malloc(sizeof(num_t) * n);
+
+		if (slots[i].values == NULL || slots[i].times == NULL) {
+			slots_destroy(slots, window);
+			free(columns);
+			free(setups);
+			return -1;
+		}
+	}
+
+	for (num_t c = 0; c < n; ++c)
+		columns[c] = ACTOR_ID_NONE;
+
+	actor_id_t first;
+
+	if (actor_system_create_ctx(&first, &role) != 0) {
+		slots_destroy(slots, window);
+		free(columns);
+		free(setups);
+		return -1;
+	}
+
+	int err = columns_build(first, n, columns, &role);
+
+	for (num_t c = 0; c < n && err == 0; ++c) {
+		setups[c].index = c;
+		setups[c].next = c + 1 < n ? columns[c + 1] : ACTOR_ID_NONE;
+
+		if (send_message(columns[c], message_of(MSG_SETUP, sizeof(column_setup_t), setups + c)) != 0)
+			err = -1;
+	}
+
+	num_t dispatched = 0;
+
+	// a slot is reused only once its row is printed, so rows come out in order
+	for (; dispatched < k && err == 0; ++dispatched) {
+		row_slot_t* row = slots + dispatched % window;
+
+		if (row->busy && row_finish(row) != 0) {
+			err = -1;
+			break;
+		}
+
+		for (num_t c = 0; c < n && err == 0; ++c) {
+			if (read_num(in, row->values + c) != 0 || read_num(in, row->times + c) != 0)
+				err = -1;
+		}
+
+		if (err != 0)
+			break;
+
+		row->sum = 0;
+		row->busy = true;
+
+		if (ask(first, message_of(MSG_ROW, sizeof(row_slot_t), row), &row->future) != 0)
+			err = -1;
+	}
+
+	for (num_t r = dispatched - window > 0 ? dispatched - window : 0; r < dispatched; ++r) {
+		row_slot_t* row = slots + r % window;
+
+		if (row->busy && row_finish(row) != 0)
+			err = -1;
+	}
+
+	for (num_t c = 0; c < n; ++c) {
+		if (columns[c] != ACTOR_ID_NONE)
+			send_message(columns[c], message_of(MSG_DONE, 0, NULL));
+	}
+
+	actor_system_join(first);
+
+	slots_destroy(slots, window);
+	free(columns);
+	free(setups);
+
+	return err;
+}
@@ -0,0 +1,155 @@
+#include "cacti_par.h"
+#include "macierz.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// a tile is about 256 KiB of values, so it fits in L2 next to its delays;
+// tests build it with smaller tiles to cut small matrices into several
+#ifndef TILE_CELLS
+#define TILE_CELLS	32768
+#endif
+#ifndef TILE_COLS
+#define TILE_COLS	4096
+#endif
+
+typedef num_t vec_t __attribute__((vector_size(32)));
+
+#define VEC_LANES	(sizeof(vec_t) / sizeof(num_t))
+
+typedef struct tiled_job {
+	num_t k;
+	num_t n;
+	num_t* values;
+	num_t* times;
+	num_t* sums;
+
+	num_t band_rows;
+	num_t chunk_cols;
+	num_t nbands;
+	num_t nchunks;
+	num_t ntiles;
+
+	_Atomic num_t* chunks_left; // per band
+	num_t* partials; // partials[chunk * k + row]
+} tiled_job_t;
+
+// sums len cells of a row and the delays that go with them
+static void row_kernel(const num_t* values, const num_t* times, num_t len, num_t* sum, num_t* delay) {
+	vec_t acc_v0 = {0}, acc_v1 = {0};
+	vec_t acc_t0 = {0}, acc_t1 = {0};
+	num_t i = 0;
+
+	for (; i + 2 * (num_t)VEC_LANES <= len; i += 2 * VEC_LANES) {
+		vec_t v0, v1, t0, t1;
+		memcpy(&v0, values + i, sizeof(vec_t));
+		memcpy(&v1, values + i + VEC_LANES, sizeof(vec_t));
+		memcpy(&t0, times + i, sizeof(vec_t));
+		memcpy(&t1, times + i + VEC_LANES, sizeof(vec_t));
+		acc_v0 += v0;
+		acc_v1 += v1;
+		acc_t0 += t0;
+		acc_t1 += t1;
+	}
+
+	acc_v0 += acc_v1;
+	acc_t0 += acc_t1;
+
+	num_t s = 0, d = 0;
+
+	for (size_t lane = 0; lane < VEC_LANES; ++lane) {
+		s += acc_v0[lane];
+		d += acc_t0[lane];
+	}
+
+	for (; i < len; ++i) {
+		s += values[i];
+		d += times[i];
+	}
+
+	*sum = s;
+	*delay += d;
+}
+
+// the last chunk of a band to finish folds the partials of the band into sums
+static void reduce_band(tiled_job_t* job, num_t band) {
+	num_t first = band * job->band_rows;
+	num_t last = first + job->band_rows < job->k ? first + job->band_rows : job->k;
+
+	for (num_t row = first; row < last; ++row) {
+		num_t s = 0;
+
+		for (num_t chunk = 0; chunk < job->nchunks; ++chunk)
+			s += job->partials[chunk * job->k + row];
+
+		job->sums[row] = s;
+	}
+}
+
+static void run_tile(tiled_job_t* job, num_t tile) {
+	num_t band = tile / job->nchunks;
+	num_t chunk = tile % job->nchunks;
+
+	num_t first_row = band * job->band_rows;
+	num_t last_row = first_row + job->band_rows < job->k ? first_row + job->band_rows : job->k;
+	num_t first_col = chunk * job->chunk_cols;
+	num_t cols = first_col + job->chunk_cols < job->n ? job->chunk_cols : job->n - first_col;
+
+	num_t delay = 0;
+
+	for (num_t row = first_row; row < last_row; ++row) {
+		num_t offset = row * job->n + first_col;
+		row_kernel(job->values + offset, job->times + offset, cols,
+			job->partials + chunk * job->k + row, &delay);
+	}
+
+	// every cell still costs its delay, only now it is paid once per tile
+	if (delay > 0)
+		usleep(delay * 1000);
+
+	if (--job->chunks_left[band] == 0)
+		reduce_band(job, band);
+}
+
+static void run_tiles(size_t begin, size_t end, void* arg) {
+	for (size_t tile = begin; tile < end; ++tile)
+		run_tile((tiled_job_t*)arg, (num_t)tile);
+}
+
+int macierz_tiled(num_t k, num_t n, num_t* values, num_t* times, num_t* sums) {
+	if (k <= 0 || n <= 0)
+		return 0;
+
+	tiled_job_t job;
+	job.k = k;
+	job.n = n;
+	job.values = values;
+	job.times = times;
+	job.sums = sums;
+
+	job.chunk_cols = n < TILE_COLS ? n : TILE_COLS;
+	job.band_rows = TILE_CELLS / job.chunk_cols;
+	job.nchunks = (n + job.chunk_cols - 1) / job.chunk_cols;
+	job.nbands = (k + job.band_rows - 1) / job.band_rows;
+	job.ntiles = job.nbands * job.nchunks;
+
+	job.chunks_left = malloc(sizeof(_Atomic num_t) * job.nbands);
+	job.partials = malloc(sizeof(num_t) * job.nchunks * k);
+
+	if (job.chunks_left == NULL || job.partials == NULL) {
+		free(job.chunks_left);
+		free(job.partials);
+		return -1;
+	}
+
+	for (num_t band = 0; band < job.nbands; ++band)
+		job.chunks_left[band] = job.nchunks;
+
+	// one tile per claim, so delayed tiles do not hold up the others
+	int check = actor_parallel_for(0, (size_t)job.ntiles, 1, run_tiles, &job);
+
+	free(job.chunks_left);
+	free(job.partials);
+
+	return check;
+}
@@ -1,14 +1,16 @@
 #include "cacti.h"
+#include "silnia.h"
 #include <stdio.h>
+#include <string.h>
 
 typedef unsigned long long num_t;
 
 #define MSG_FACTORIZE	(message_type_t)1
 #define MSG_SEND		(message_type_t)2
 
-message_t message_spawn(role_t* role) {
+message_t message_spawn(role_ctx_t* role) {
 	message_t msg;
-	msg.message_type = MSG_SPAWN;
+	msg.message_type = MSG_SPAWN_CTX;
 	msg.nbytes = sizeof(role->nprompts) + sizeof(role->prompts);
 	msg.data = role;
 	return msg;
@@ -37,13 +39,14 @@ message_t message_send(size_t nbytes, void* data) {
 }
 
 
-void hello(void** stateptr, size_t nbytes, void* data) {
+void hello(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
+	(void)ctx;
 	(void)stateptr;
 	(void)nbytes;
 	(void)data;
 }
 
-void factorize(void **stateptr, size_t nbytes, void *data) {
+void factorize(actor_ctx_t* ctx, void **stateptr, size_t nbytes, void *data) {
 	(void)stateptr;
 	
 	num_t** my_data = (num_t**)data;
@@ -51,8 +54,8 @@ void factorize(void **stateptr, size_t nbytes, void *data) {
 	num_t* k = *(my_data + 1);
 	num_t* k_factorial = *(my_data + 2);
 
-	role_t** role_data = (role_t**)data;
-	role_t* role = *(role_data + 3);
+	role_ctx_t** role_data = (role_ctx_t**)data;
+	role_ctx_t* role = *(role_data + 3);
 
 	if (*k == *n) {
 		*n = *(k_factorial);
@@ -61,31 +64,36 @@ void factorize(void **stateptr, size_t nbytes, void *data) {
 		*k = *k + 1;
 		*k_factorial = (*k_factorial) * (*k);
 		
-		if (send_message(actor_id_self(), message_spawn(role)) != 0) {
+		if (ctx_send(ctx, ctx->self, message_spawn(role)) != 0) {
 			exit(-2);
 		}
 		
-		if (send_message(actor_id_self(), message_send(nbytes, data)) != 0) {
+		if (ctx_send(ctx, ctx->self, message_send(nbytes, data)) != 0) {
 			exit(-2);
 		}
 	}
 
-	if (send_message(actor_id_self(), message_godie()) != 0) {
+	if (ctx_send(ctx, ctx->self, message_godie()) != 0) {
 		exit(-2);
 	}
 }
 
-void send(void** stateptr, size_t nbytes, void* data) {
+void send(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data) {
 	(void)stateptr;
 
-	if (send_message(actor_id_self() + 1, message_factorize(nbytes, data)) != 0) {
+	if (ctx_send(ctx, ctx->self + 1, message_factorize(nbytes, data)) != 0) {
 		exit(-2);
 	}
 }
 
-typedef void (* act_t2)(void** stateptr, size_t nbytes, void* data);
+typedef void (* act_ctx_t2)(actor_ctx_t* ctx, void** stateptr, size_t nbytes, void* data);
+
+// past 20! the chain would overflow num_t, so bigger inputs take the product tree
+#define SILNIA_CHAIN_MAX 20
+
+int main(int argc, char** argv) {
+	bool big = argc > 1 && strcmp(argv[1], "--big") == 0;
 
-int main() {
 	unsigned long long number;
 	scanf("%lld", &number);
 
@@ -94,22 +102,25 @@ int main() {
 		return 0;
 	}
 
-	role_t role;
+	if (big || number > SILNIA_CHAIN_MAX)
+		return silnia_big(number, stdout) == 0 ? 0 : -1;
+
+	role_ctx_t role;
 	role.nprompts = 3;
 
-	act_t2* acts = (act_t2*)malloc(sizeof(act_t2) * role.nprompts);
+	act_ctx_t2* acts = (act_ctx_t2*)malloc(sizeof(act_ctx_t2) * role.nprompts);
 
-	*(acts) = (act_t2)hello;
+	*(acts) = hello;
 	*(acts + 1) = factorize;
 	*(acts + 2) = send;
 
-	role.prompts = (act_t*)acts;
+	role.prompts = (act_ctx_t*)acts;
 
 	num_t n = (num_t)number;
 	num_t k = 1;
 	num_t k_factorial = 1;
 
-	size_t nbytes = sizeof(role_t) + 3 * sizeof(num_t);
+	size_t nbytes = sizeof(role_ctx_t) + 3 * sizeof(num_t);
 	void** data = malloc(nbytes);
 	*data = &n;
 	*(data + 1) = &k;
@@ -118,7 +129,7 @@ int main() {
 
 	actor_id_t a;
 
-	if (actor_system_create(&a, &role) != 0)
+	if (actor_system_create_ctx(&a, &role) != 0)
 		exit(-1);
 	
 	int check = send_message(a, message_factorize(nbytes, (void*)data));
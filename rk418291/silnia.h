@@ -0,0 +1,12 @@
+#ifndef SILNIA_H
+#define SILNIA_H
+
+#include <stdio.h>
+
+// prints n! in full, multiplying ranges of [1, n] with a bounded set of actors; n < 10^9
+int silnia_big(unsigned long long n, FILE* out);
+
+// how many multiplications silnia_big has split into actor tasks so far
+size_t silnia_big_splits();
+
+#endif
@@ -0,0 +1,307 @@
+#include "cacti_par.h"
+#include "silnia.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BIG_BASE		1000000000u
+#define KARATSUBA_MIN	32
+// halves at least this long are multiplied as three actor tasks
+#define KARATSUBA_TASK_MIN	2048
+#define BIG_LEAVES		256
+
+typedef uint32_t limb_t;
+
+// little-endian digits in base 10^9
+typedef struct big {
+	limb_t* d;
+	size_t len;
+	size_t cap;
+} big_t;
+
+// out[0..2n) = a * b, one of the three products of a Karatsuba step
+typedef struct karatsuba_part {
+	const limb_t* a;
+	const limb_t* b;
+	size_t n;
+	limb_t* out;
+} karatsuba_part_t;
+
+static _Atomic size_t splits;
+
+static void big_reserve(big_t* x, size_t cap) {
+	if (x->cap >= cap)
+		return;
+
+	limb_t* d = realloc(x->d, sizeof(limb_t) * cap);
+
+	if (d == NULL)
+		exit(-1);
+
+	x->d = d;
+	x->cap = cap;
+}
+
+static void big_trim(big_t* x) {
+	while (x->len > 1 && x->d[x->len - 1] == 0)
+		--x->len;
+}
+
+static void big_mul_small(big_t* x, uint64_t m) {
+	uint64_t carry = 0;
+
+	for (size_t i = 0; i < x->len; ++i) {
+		uint64_t cur = x->d[i] * m + carry;
+		x->d[i] = (limb_t)(cur % BIG_BASE);
+		carry = cur / BIG_BASE;
+	}
+
+	while (carry != 0) {
+		big_reserve(x, x->len * 2 + 1);
+		x->d[x->len++] = (limb_t)(carry % BIG_BASE);
+		carry /= BIG_BASE;
+	}
+}
+
+// x[0..xn) += y[0..yn); the sum has to fit in xn limbs
+static void limbs_add(limb_t* x, size_t xn, const limb_t* y, size_t yn) {
+	limb_t carry = 0;
+	size_t i = 0;
+
+	for (; i < yn; ++i) {
+		limb_t s = x[i] + y[i] + carry;
+		carry = s >= BIG_BASE;
+		x[i] = carry ? s - BIG_BASE : s;
+	}
+
+	for (; carry != 0 && i < xn; ++i) {
+		limb_t s = x[i] + 1;
+		carry = s >= BIG_BASE;
+		x[i] = carry ? s - BIG_BASE : s;
+	}
+}
+
+// x[0..xn) -= y[0..yn); x must not be smaller than y
+static void limbs_sub(limb_t* x, size_t xn, const limb_t* y, size_t yn) {
+	limb_t borrow = 0;
+	size_t i = 0;
+
+	for (; i < yn; ++i) {
+		int64_t d = (int64_t)x[i] - y[i] - borrow;
+		borrow = d < 0;
+		x[i] = (limb_t)(borrow ? d + BIG_BASE : d);
+	}
+
+	for (; borrow != 0 && i < xn; ++i) {
+		int64_t d = (int64_t)x[i] - 1;
+		borrow = d < 0;
+		x[i] = (limb_t)(borrow ? d + BIG_BASE : d);
+	}
+}
+
+// out[0..an + bn) = a * b; out has to be zeroed
+static void limbs_mul_school(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* out) {
+	for (size_t i = 0; i < an; ++i) {
+		uint64_t ai = a[i];
+		uint64_t carry = 0;
+
+		if (ai == 0)
+			continue;
+
+		for (size_t j = 0; j < bn; ++j) {
+			uint64_t cur = out[i + j] + ai * b[j] + carry;
+			out[i + j] = (limb_t)(cur % BIG_BASE);
+			carry = cur / BIG_BASE;
+		}
+
+		for (size_t k = i + bn; carry != 0; ++k) {
+			uint64_t cur = out[k] + carry;
+			out[k] = (limb_t)(cur % BIG_BASE);
+			carry = cur / BIG_BASE;
+		}
+	}
+}
+
+static limb_t* limbs_zeroed(size_t n) {
+	limb_t* x = calloc(n, sizeof(limb_t));
+
+	if (x == NULL)
+		exit(-1);
+
+	return x;
+}
+
+static void limbs_mul_karatsuba(const limb_t* a, const limb_t* b, size_t n, limb_t* out);
+
+static void karatsuba_parts(size_t begin, size_t end, void* arg) {
+	karatsuba_part_t* parts = (karatsuba_part_t*)arg;
+
+	for (size_t i = begin; i < end; ++i)
+		limbs_mul_karatsuba(parts[i].a, parts[i].b, parts[i].n, parts[i].out);
+}
+
+// out[0..2n) = a * b for two n limb numbers; out has to be zeroed
+static void limbs_mul_karatsuba(const limb_t* a, const limb_t* b, size_t n, limb_t* out) {
+	if (n < KARATSUBA_MIN) {
+		limbs_mul_school(a, n, b, n, out);
+		return;
+	}
+
+	size_t m = n / 2; // low half
+	size_t h = n - m; // high half, h >= m
+
+	limb_t* sa = limbs_zeroed(h + 1);
+	limb_t* sb = limbs_zeroed(h + 1);
+	limb_t* z1 = limbs_zeroed(2 * (h + 1));
+
+	memcpy(sa, a + m, sizeof(limb_t) * h);
+	memcpy(sb, b + m, sizeof(limb_t) * h);
+	limbs_add(sa, h + 1, a, m);
+	limbs_add(sb, h + 1, b, m);
+
+	// z0 = a0 * b0 and z2 = a1 * b1 land in their final places,
+	// (a0 + a1)(b0 + b1) in z1; none of them overlap
+	karatsuba_part_t parts[3] = {
+		{a, b, m, out},
+		{a + m, b + m, h, out + 2 * m},
+		{sa, sb, h + 1, z1},
+	};
+
+	// the top of the product tree is a few huge multiplications, which only
+	// spread over the workers when their parts do
+	if (m >= KARATSUBA_TASK_MIN && actor_parallel_for(0, 3, 1, karatsuba_parts, parts) == 0) {
+		++splits;
+	}
+	else {
+		// a split that failed may have left some parts done
+		if (m >= KARATSUBA_TASK_MIN) {
+			memset(out, 0, sizeof(limb_t) * 2 * n);
+			memset(z1, 0, sizeof(limb_t) * 2 * (h + 1));
+		}
+
+		karatsuba_parts(0, 3, parts);
+	}
+
+	// z1 = (a0 + a1)(b0 + b1) - z0 - z2 = a0 * b1 + a1 * b0
+	limbs_sub(z1, 2 * (h + 1), out, 2 * m);
+	limbs_sub(z1, 2 * (h + 1), out + 2 * m, 2 * h);
+
+	size_t z1n = 2 * (h + 1) < 2 * n - m ? 2 * (h + 1) : 2 * n - m;
+	limbs_add(out + m, 2 * n - m, z1, z1n);
+
+	free(sa);
+	free(sb);
+	free(z1);
+}
+
+// out[0..an + bn) = a * b; out has to be zeroed
+static void limbs_mul(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* out) {
+	if (an < bn) {
+		limbs_mul(b, bn, a, an, out);
+		return;
+	}
+
+	if (bn < KARATSUBA_MIN) {
+		limbs_mul_school(a, an, b, bn, out);
+		return;
+	}
+
+	if (an == bn) {
+		limbs_mul_karatsuba(a, b, an, out);
+		return;
+	}
+
+	// unbalanced: cut a into pieces as long as b
+	limb_t* piece = limbs_zeroed(2 * bn);
+
+	for (size_t off = 0; off < an; off += bn) {
+		size_t len = an - off < bn ? an - off : bn;
+
+		memset(piece, 0, sizeof(limb_t) * 2 * bn);
+		limbs_mul(a + off, len, b, bn, piece);
+		limbs_add(out + off, an + bn - off, piece, len + bn);
+	}
+
+	free(piece);
+}
+
+static big_t big_mul(const big_t* a, const big_t* b) {
+	big_t x;
+	x.len = x.cap = a->len + b->len;
+	x.d = limbs_zeroed(x.cap);
+
+	limbs_mul(a->d, a->len, b->d, b->len, x.d);
+	big_trim(&x);
+	return x;
+}
+
+// the product of [lo, hi), folding small factors together before touching the limbs;
+// hi is at most BIG_BASE, so m * i always fits
+static big_t big_range(unsigned long long lo, unsigned long long hi) {
+	big_t x;
+	x.cap = 16;
+	x.len = 1;
+	x.d = limbs_zeroed(x.cap);
+	x.d[0] = 1;
+
+	uint64_t m = 1;
+
+	for (unsigned long long i = lo; i < hi; ++i) {
+		if (m * i >= BIG_BASE) {
+			big_mul_small(&x, m);
+			m = 1;
+		}
+
+		m *= i;
+	}
+
+	big_mul_small(&x, m);
+	return x;
+}
+
+static void big_print(const big_t* x, FILE* out) {
+	fprintf(out, "%u", x->d[x->len - 1]);
+
+	for (size_t i = x->len - 1; i-- > 0;)
+		fprintf(out, "%09u", x->d[i]);
+
+	fprintf(out, "\n");
+}
+
+static void range_leaf(size_t begin, size_t end, void* value, void* arg) {
+	(void)arg;
+	*(big_t*)value = big_range(begin, end);
+}
+
+static void product_combine(void* acc, void* other, void* arg) {
+	(void)arg;
+
+	big_t* left = (big_t*)acc;
+	big_t* right = (big_t*)other;
+	big_t product = big_mul(left, right);
+
+	free(left->d);
+	free(right->d);
+	*left = product;
+}
+
+size_t silnia_big_splits() {
+	return splits;
+}
+
+int silnia_big(unsigned long long n, FILE* out) {
+	if (n >= BIG_BASE)
+		return -1;
+
+	big_t result;
+	size_t grain = n / BIG_LEAVES + 1;
+
+	if (actor_reduce(1, n + 1, grain, sizeof(big_t), &result, range_leaf, product_combine, NULL) != 0)
+		return -1;
+
+	big_print(&result, out);
+	free(result.d);
+
+	return 0;
+}
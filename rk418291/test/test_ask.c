@@ -0,0 +1,132 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MSG_DOUBLE (message_type_t)1
+#define MSG_IGNORE (message_type_t)2
+#define MSG_RELAY (message_type_t)3
+
+int tests_run = 0;
+
+// a child spawned for an ask answers it and leaves
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (ctx->sender != ACTOR_ID_NONE)
+    {
+        message_t reply = {MSG_HELLO, 0, NULL};
+        message_t godie = {MSG_GODIE, 0, NULL};
+        ctx_reply(ctx, reply);
+        ctx_send(ctx, ctx->self, godie);
+    }
+}
+
+static void twice(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    long *value = (long *)data;
+    *value *= 2;
+    message_t reply = {MSG_DOUBLE, sizeof(long), value};
+    ctx_reply(ctx, reply);
+}
+
+static void ignore(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void relay(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    message_t msg = {MSG_DOUBLE, nbytes, data};
+    ctx_forward(ctx, ctx->self, msg);
+}
+
+static act_ctx_t prompts[] = {hello, twice, ignore, relay};
+static role_ctx_t role = {4, prompts};
+
+static char *ask_replies()
+{
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    for (long i = 0; i < 100; ++i)
+    {
+        long value = i;
+        future_t f;
+        message_t reply;
+        message_t msg = {MSG_DOUBLE, sizeof(long), &value};
+        mu_assert("ask", ask(a, msg, &f) == 0);
+        mu_assert("wait", future_wait(&f, &reply) == FUTURE_SUCCESS);
+        mu_assert("reply", *(long *)reply.data == 2 * i);
+        future_destroy(&f);
+    }
+
+    future_t f;
+    message_t msg = {MSG_IGNORE, 0, NULL};
+    mu_assert("ask ignored", ask(a, msg, &f) == 0);
+    mu_assert("broken", future_wait_for(&f, NULL, 500) == FUTURE_BROKEN);
+    future_destroy(&f);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie", send_message(a, godie) == 0);
+    actor_system_join(a);
+    return 0;
+}
+
+static char *forward_keeps_reply()
+{
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    long value = 21;
+    future_t f;
+    message_t reply;
+    message_t msg = {MSG_RELAY, sizeof(long), &value};
+    mu_assert("ask relay", ask(a, msg, &f) == 0);
+    mu_assert("wait relay", future_wait(&f, &reply) == FUTURE_SUCCESS);
+    mu_assert("relayed", *(long *)reply.data == 42);
+    future_destroy(&f);
+
+    message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+    mu_assert("ask spawn", ask(a, spawn, &f) == 0);
+    mu_assert("child answers", future_wait(&f, NULL) == FUTURE_SUCCESS);
+    future_destroy(&f);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie", send_message(a, godie) == 0);
+    actor_system_join(a);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(ask_replies);
+    mu_run_test(forward_keeps_reply);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
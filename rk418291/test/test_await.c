@@ -0,0 +1,196 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define MSG_DOUBLE (message_type_t)1
+#define MSG_IGNORE (message_type_t)2
+#define MSG_START (message_type_t)3
+#define MSG_TICK (message_type_t)4
+#define MSG_NAP (message_type_t)5
+
+#define ASKS 100
+
+int tests_run = 0;
+
+static actor_id_t helper;
+static long sum;
+static int started;
+static int overlapped;
+static int broken;
+static long ticks;
+static long ticks_while_asleep;
+static long slept_ms;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void twice(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    long *value = (long *)data;
+    *value *= 2;
+    message_t reply = {MSG_DOUBLE, sizeof(long), value};
+    ctx_reply(ctx, reply);
+}
+
+static void ignore(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+// asks the helper in a loop, with no other start allowed in between
+static void start(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (started++ != 0)
+        ++overlapped;
+
+    for (long i = 0; i < ASKS; ++i)
+    {
+        long value = i;
+        message_t reply;
+        message_t msg = {MSG_DOUBLE, sizeof(long), &value};
+        if (ctx_await(ctx, helper, msg, &reply) == FUTURE_SUCCESS)
+            sum += *(long *)reply.data;
+    }
+
+    message_t msg = {MSG_IGNORE, 0, NULL};
+    if (ctx_await(ctx, helper, msg, NULL) == FUTURE_BROKEN)
+        ++broken;
+
+    --started;
+}
+
+static void tick(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++ticks;
+}
+
+static long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void nap(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    long before = now_ms();
+    long ticks_before = ticks;
+    ctx_sleep(ctx, 20);
+    slept_ms = now_ms() - before;
+    ticks_while_asleep = ticks - ticks_before;
+}
+
+static act_ctx_t prompts[] = {hello, twice, ignore, start, tick, nap};
+static role_ctx_t role = {6, prompts};
+
+// a single worker, so the helper only gets to answer if awaiting lets the worker go
+static char *single_worker(actor_id_t *a)
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.min_workers = 1;
+    config.max_workers = 1;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    mu_assert("create", actor_system_create_ctx(a, &role) == 0);
+    actor_group_config_t group = {ACTOR_GROUP_ROUND_ROBIN, 1, NULL};
+    mu_assert("helper", actor_group_create(&helper, &role, &group) == 0);
+    mu_assert("suspendable", actor_suspendable(*a) == 0);
+    return 0;
+}
+
+static char *await_replies()
+{
+    actor_id_t a;
+    char *result = single_worker(&a);
+    if (result != 0)
+        return result;
+
+    sum = started = overlapped = broken = 0;
+
+    message_t msg = {MSG_START, 0, NULL};
+    mu_assert("start", send_message(a, msg) == 0);
+    mu_assert("start again", send_message(a, msg) == 0);
+    actor_system_join(a);
+
+    mu_assert("answers", sum == 2 * (long)ASKS * (ASKS - 1));
+    mu_assert("one at a time", overlapped == 0);
+    mu_assert("broken", broken == 2);
+    return 0;
+}
+
+static char *sleep_frees_worker()
+{
+    actor_id_t a;
+    char *result = single_worker(&a);
+    if (result != 0)
+        return result;
+
+    ticks = 0;
+
+    message_t msg = {MSG_NAP, 0, NULL};
+    mu_assert("nap", send_message(a, msg) == 0);
+
+    message_t tick_msg = {MSG_TICK, 0, NULL};
+    for (int i = 0; i < 100; ++i)
+        mu_assert("tick", send_message(helper, tick_msg) == 0);
+
+    actor_system_join(a);
+
+    mu_assert("slept", slept_ms >= 20);
+    mu_assert("others ran", ticks_while_asleep == 100);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(await_replies);
+    mu_run_test(sleep_frees_worker);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
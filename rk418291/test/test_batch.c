@@ -0,0 +1,244 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_SLOW (message_type_t)1
+#define MSG_ADD (message_type_t)2
+#define MSG_MARK (message_type_t)3
+#define MSG_FEED (message_type_t)4
+
+#define MESSAGES 1000
+#define BATCH 16
+#define FEEDERS 3
+#define FED 100
+#define SLOTS 64
+
+int tests_run = 0;
+
+static long next_seq[SLOTS];
+static bool in_order = true;
+static long handled = 0;
+static long sum = 0;
+static long batches = 0;
+static long mixed = 0;
+static _Atomic bool slowed = false;
+static _Atomic bool released = false;
+static _Atomic int fed = 0;
+static _Atomic actor_id_t target = ACTOR_ID_NONE;
+
+// every sender's messages carry its own sequence numbers
+static void seen(actor_id_t sender, size_t seq)
+{
+    size_t slot = sender == ACTOR_ID_NONE ? 0 : 1 + (size_t)sender % (SLOTS - 1);
+
+    if ((long)seq != next_seq[slot]++)
+        in_order = false;
+    ++handled;
+}
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+// holds the actor until what the test sends has piled up behind it
+static void slow(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    slowed = true;
+    while (!released)
+        usleep(100);
+}
+
+static void add(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    seen(ctx->sender, nbytes);
+    sum += (long)nbytes;
+}
+
+static void mark(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    seen(ctx->sender, nbytes);
+}
+
+static void feed(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    for (size_t i = 0; i < FED; ++i)
+    {
+        message_t msg = {MSG_ADD, i, NULL};
+        ctx_send(ctx, target, msg);
+    }
+
+    ++fed;
+}
+
+static void add_batch(actor_ctx_t *ctx, void **stateptr, size_t count, message_t const *messages,
+                      actor_id_t const *senders)
+{
+    (void)stateptr;
+
+    ++batches;
+    if (count > BATCH || senders[0] != ctx->sender)
+        in_order = false;
+
+    bool several = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (messages[i].message_type != MSG_ADD)
+            in_order = false;
+        if (senders[i] != senders[0])
+            several = true;
+
+        seen(senders[i], messages[i].nbytes);
+        sum += (long)messages[i].nbytes;
+    }
+
+    if (several)
+        ++mixed;
+}
+
+static act_ctx_t prompts[] = {hello, slow, add, mark, feed};
+static role_ctx_t role = {5, prompts};
+
+static void reset()
+{
+    for (int i = 0; i < SLOTS; ++i)
+        next_seq[i] = 0;
+
+    in_order = true;
+    handled = sum = batches = mixed = 0;
+    slowed = released = false;
+    fed = 0;
+}
+
+static char *start(actor_id_t *a)
+{
+    reset();
+
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    mu_assert("create", actor_system_create_ctx(a, &role) == 0);
+    target = *a;
+
+    message_t msg = {MSG_SLOW, 0, NULL};
+    mu_assert("send slow", send_message(*a, msg) == 0);
+
+    while (!slowed)
+        usleep(100);
+
+    return 0;
+}
+
+// the marks split the adds queued behind the slow message into runs
+static char *runs_in_order()
+{
+    mu_assert("no hello batches", actor_batch_prompt(&role, MSG_HELLO, add_batch, BATCH) != 0);
+    mu_assert("too long", actor_batch_prompt(&role, MSG_ADD, add_batch, ACTOR_BATCH_MAX + 1) != 0);
+    mu_assert("batch prompt", actor_batch_prompt(&role, MSG_ADD, add_batch, BATCH) == 0);
+
+    actor_id_t a;
+    char *err = start(&a);
+    if (err != 0)
+        return err;
+
+    long total = 0;
+    for (long i = 0; i < MESSAGES; ++i)
+    {
+        message_t next = {i % 100 == 99 ? MSG_MARK : MSG_ADD, (size_t)i, NULL};
+        mu_assert("send", send_message(a, next) == 0);
+        if (next.message_type == MSG_ADD)
+            total += i;
+    }
+
+    released = true;
+    actor_system_join(a);
+    mu_assert("all handled", handled == MESSAGES);
+    mu_assert("in order", in_order);
+    mu_assert("sum", sum == total);
+    mu_assert("batched", batches > 0 && batches < MESSAGES / 4);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+// the same updates from several actors still go out in batches
+static char *senders_mix()
+{
+    actor_id_t a;
+    char *err = start(&a);
+    if (err != 0)
+        return err;
+
+    actor_id_t feeders;
+    actor_group_config_t group = {ACTOR_GROUP_ROUND_ROBIN, FEEDERS, NULL};
+    mu_assert("feeders", actor_group_create(&feeders, &role, &group) == 0);
+
+    message_t msg = {MSG_FEED, 0, NULL};
+    for (int i = 0; i < FEEDERS; ++i)
+        mu_assert("send feed", send_message(feeders, msg) == 0);
+
+    while (fed < FEEDERS)
+        usleep(100);
+
+    released = true;
+    actor_system_join(a);
+    mu_assert("all handled", handled == FEEDERS * FED);
+    mu_assert("in order", in_order);
+    mu_assert("sum", sum == FEEDERS * FED * (FED - 1) / 2);
+    mu_assert("batched", batches <= FEEDERS * FED / 4);
+    mu_assert("mixed", mixed > 0);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(runs_in_order);
+    mu_run_test(senders_mix);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,109 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MSG_READ (message_type_t)1
+#define MSG_KEPT (message_type_t)2
+
+#define TABLE 4096
+#define READERS 200
+
+int tests_run = 0;
+
+static long *table;
+static _Atomic long reads = 0;
+static _Atomic bool copied = false;
+static actor_buffer_t *kept = NULL;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void read_table(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+
+    if (data != table || nbytes != sizeof(long) * TABLE || ((long *)data)[TABLE - 1] != TABLE - 1)
+        copied = true;
+
+    ++reads;
+}
+
+// keeps the block past the handler, the way a cache would
+static void keep_table(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+
+    kept = buffer_retain(buffer_of(data));
+}
+
+static act_ctx_t prompts[] = {hello, read_table, keep_table};
+static role_ctx_t role = {3, prompts};
+
+static char *fan_out_shares_one_block()
+{
+    actor_buffer_t *buffer = buffer_create(sizeof(long) * TABLE);
+    mu_assert("buffer", buffer != NULL);
+
+    table = (long *)buffer_data(buffer);
+    for (long i = 0; i < TABLE; ++i)
+        table[i] = i;
+
+    actor_id_t root;
+    mu_assert("create", actor_system_create_ctx(&root, &role) == 0);
+
+    actor_id_t group;
+    actor_group_config_t config = {ACTOR_GROUP_BALANCE, 4, NULL};
+    mu_assert("group", actor_group_create(&group, &role, &config) == 0);
+
+    for (int i = 0; i < READERS; ++i)
+        mu_assert("send", send_buffer(group, MSG_READ, buffer) == 0);
+
+    mu_assert("send kept", send_buffer(root, MSG_KEPT, buffer) == 0);
+
+    // the messages hold their own references
+    buffer_release(buffer);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie group", send_message(group, godie) == 0);
+    mu_assert("godie root", send_message(root, godie) == 0);
+    actor_system_join(root);
+
+    mu_assert("all read", reads == READERS);
+    mu_assert("no copies", !copied);
+    mu_assert("kept", kept != NULL && buffer_data(kept) == table && table[TABLE - 1] == TABLE - 1);
+
+    buffer_release(kept);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(fan_out_shares_one_block);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,216 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_WORK (message_type_t)1
+#define MSG_HOLD (message_type_t)2
+
+#define KEYS 16
+#define MAX_ID 64
+
+int tests_run = 0;
+
+static _Atomic long handled = 0;
+static _Atomic long fast_before_slow = 0;
+static _Atomic bool slow_done = false;
+static _Atomic long per_member[MAX_ID];
+static _Atomic actor_id_t owner[KEYS];
+static _Atomic bool owner_changed = false;
+static _Atomic bool held = true;
+static _Atomic int holding = 0;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+// nbytes is the key; key 0 is slow
+static void work(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    if (data != NULL && nbytes == 0)
+    {
+        usleep(100000);
+        slow_done = true;
+    }
+    else if (data != NULL && !slow_done)
+    {
+        ++fast_before_slow;
+    }
+
+    actor_id_t expected = ACTOR_ID_NONE;
+    if (!atomic_compare_exchange_strong(&owner[nbytes % KEYS], &expected, ctx->self) && expected != ctx->self)
+        owner_changed = true;
+
+    ++per_member[ctx->self % MAX_ID];
+    ++handled;
+}
+
+// keeps a member busy until the test lets go
+static void hold(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    ++holding;
+    while (held)
+        usleep(100);
+}
+
+static act_ctx_t prompts[] = {hello, work, hold};
+static role_ctx_t role = {3, prompts};
+
+static uint64_t key_of(message_t const *message)
+{
+    return message->nbytes;
+}
+
+static void reset()
+{
+    handled = 0;
+    fast_before_slow = 0;
+    slow_done = false;
+    owner_changed = false;
+
+    for (int i = 0; i < MAX_ID; ++i)
+        per_member[i] = 0;
+
+    for (int i = 0; i < KEYS; ++i)
+        owner[i] = ACTOR_ID_NONE;
+}
+
+static char *run_group(int routing, size_t members, long count, bool slow, actor_id_t *group)
+{
+    reset();
+
+    actor_id_t root;
+    mu_assert("create", actor_system_create_ctx(&root, &role) == 0);
+
+    actor_group_config_t config = {routing, members, key_of};
+    mu_assert("group", actor_group_create(group, &role, &config) == 0);
+
+    static int marker;
+    for (long i = 0; i < count; ++i)
+    {
+        message_t msg = {MSG_WORK, (size_t)(slow ? i : i % KEYS + 1), slow ? &marker : NULL};
+        mu_assert("send", send_message(*group, msg) == 0);
+    }
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie group", send_message(*group, godie) == 0);
+    mu_assert("godie root", send_message(root, godie) == 0);
+    actor_system_join(root);
+
+    mu_assert("all handled", handled == count);
+    return 0;
+}
+
+static char *balance_skips_busy_member()
+{
+    actor_id_t group;
+    char *err = run_group(ACTOR_GROUP_BALANCE, 4, 101, true, &group);
+    if (err != 0)
+        return err;
+
+    mu_assert("fast ones pass the slow one", fast_before_slow == 100);
+    return 0;
+}
+
+static char *round_robin_spreads_evenly()
+{
+    actor_id_t group;
+    char *err = run_group(ACTOR_GROUP_ROUND_ROBIN, 4, 40, false, &group);
+    if (err != 0)
+        return err;
+
+    // members were created right before the group address
+    for (actor_id_t m = group - 4; m < group; ++m)
+        mu_assert("even", per_member[m % MAX_ID] == 10);
+
+    return 0;
+}
+
+static char *hash_keeps_keys_on_one_member()
+{
+    actor_id_t group;
+    char *err = run_group(ACTOR_GROUP_HASH, 5, 200, false, &group);
+    if (err != 0)
+        return err;
+
+    mu_assert("stable", !owner_changed);
+    return 0;
+}
+
+// every member is busy and the shared queue is full, yet the group still takes its godie
+static char *balance_godie_when_full()
+{
+    reset();
+    held = true;
+    holding = 0;
+
+    actor_id_t root, group;
+    mu_assert("create", actor_system_create_ctx(&root, &role) == 0);
+
+    // a member per worker
+    actor_group_config_t config = {ACTOR_GROUP_BALANCE, POOL_SIZE, NULL};
+    mu_assert("group", actor_group_create(&group, &role, &config) == 0);
+
+    message_t msg = {MSG_HOLD, 0, NULL};
+    for (int i = 0; i < POOL_SIZE; ++i)
+        mu_assert("send hold", send_message(group, msg) == 0);
+
+    while (holding < POOL_SIZE)
+        usleep(100);
+
+    long sent = 0;
+    message_t job = {MSG_WORK, 1, NULL};
+    while (send_message(group, job) == 0)
+        ++sent;
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie group", send_message(group, godie) == 0);
+    mu_assert("godie root", send_message(root, godie) == 0);
+
+    held = false;
+    actor_system_join(root);
+
+    mu_assert("filled", sent >= ACTOR_QUEUE_LIMIT);
+    mu_assert("all handled", handled == sent);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(balance_skips_busy_member);
+    mu_run_test(round_robin_spreads_evenly);
+    mu_run_test(hash_keeps_keys_on_one_member);
+    mu_run_test(balance_godie_when_full);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
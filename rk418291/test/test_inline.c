@@ -0,0 +1,156 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MSG_PING (message_type_t)1
+#define MSG_ASK (message_type_t)2
+
+#define ROUNDS 10000
+
+int tests_run = 0;
+
+static pthread_t joiner;
+static bool foreign_thread;
+static long pings;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+
+    // the spawned partner starts the rally
+    if (ctx->sender != ACTOR_ID_NONE)
+    {
+        message_t ping = {MSG_PING, 0, NULL};
+        ctx_send(ctx, *(actor_id_t *)data, ping);
+    }
+}
+
+static void ping(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (!pthread_equal(pthread_self(), joiner))
+        foreign_thread = true;
+
+    message_t msg = {MSG_PING, 0, NULL};
+    if (++pings < ROUNDS)
+        ctx_send(ctx, ctx->sender, msg);
+}
+
+static void answer(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    message_t reply = {MSG_ASK, 0, data};
+    ctx_reply(ctx, reply);
+}
+
+static act_ctx_t prompts[] = {hello, ping, answer};
+static role_ctx_t role = {3, prompts};
+
+static char *configure(int executor, int workers)
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.executor = executor;
+    config.min_workers = workers;
+    config.max_workers = workers;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *ping_pong()
+{
+    char *result = configure(ACTOR_EXECUTOR_INLINE, 0);
+    if (result != 0)
+        return result;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("no workers", actor_pool_workers() == 0);
+
+    joiner = pthread_self();
+    foreign_thread = false;
+    pings = 0;
+
+    message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+    mu_assert("spawn", send_message(a, spawn) == 0);
+    actor_system_join(a);
+
+    mu_assert("rally", pings == ROUNDS);
+    mu_assert("joiner ran it", !foreign_thread);
+    return 0;
+}
+
+static char *ask_before_join()
+{
+    char *result = configure(ACTOR_EXECUTOR_AUTO, 1);
+    if (result != 0)
+        return result;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("auto inline", actor_pool_workers() == 0);
+
+    for (long i = 0; i < 100; ++i)
+    {
+        future_t f;
+        message_t reply;
+        message_t msg = {MSG_ASK, 0, (void *)(intptr_t)i};
+        mu_assert("ask", ask(a, msg, &f) == 0);
+        mu_assert("wait", future_wait(&f, &reply) == FUTURE_SUCCESS);
+        mu_assert("reply", (intptr_t)reply.data == i);
+        future_destroy(&f);
+    }
+
+    actor_system_join(a);
+    return 0;
+}
+
+static char *auto_pool()
+{
+    char *result = configure(ACTOR_EXECUTOR_AUTO, 2);
+    if (result != 0)
+        return result;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("pooled", actor_pool_workers() > 0);
+    actor_system_join(a);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(ping_pong);
+    mu_run_test(ask_before_join);
+    mu_run_test(auto_pool);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
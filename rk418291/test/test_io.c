@@ -0,0 +1,273 @@
+#include "minunit.h"
+#include "cacti_io.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MSG_WRITE (message_type_t)1
+#define MSG_WRITTEN (message_type_t)2
+#define MSG_READ (message_type_t)3
+#define MSG_FILE_WRITTEN (message_type_t)4
+#define MSG_FILE_READ (message_type_t)5
+#define MSG_ACCEPTED (message_type_t)6
+
+int tests_run = 0;
+
+static int sv[2];
+static int file_fd;
+static int listen_fd;
+
+static bool written = false;
+static bool read_back = false;
+static bool file_read_back = false;
+static bool accepted = false;
+static bool late_read = false;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void do_write(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_written(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_file_written(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_file_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_accepted(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+
+static act_ctx_t prompts[] = {hello, do_write, on_written, on_read, on_file_written, on_file_read, on_accepted};
+static role_ctx_t role = {7, prompts};
+
+static void wait_hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void on_late_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+
+static act_ctx_t wait_prompts[] = {wait_hello, on_late_read};
+static role_ctx_t wait_role = {2, wait_prompts};
+
+static actor_buffer_t *text(char const *s)
+{
+    actor_buffer_t *buffer = buffer_create(strlen(s));
+    memcpy(buffer_data(buffer), s, strlen(s));
+    return buffer;
+}
+
+// the read waits in epoll for what only the next message writes, on the only worker
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    actor_io_read(ctx->self, MSG_READ, sv[0], 64, -1);
+
+    message_t msg = {MSG_WRITE, 0, NULL};
+    ctx_send(ctx, ctx->self, msg);
+}
+
+static void do_write(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    actor_io_write(ctx->self, MSG_WRITTEN, sv[1], text("ping"), -1);
+}
+
+static void on_written(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+
+    actor_io_t *io = (actor_io_t *)data;
+    written = io->op == ACTOR_IO_WRITE && io->result == 4;
+}
+
+static void on_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+
+    actor_io_t *io = (actor_io_t *)data;
+    read_back = io->op == ACTOR_IO_READ && io->result == 4 && memcmp(io->data, "ping", 4) == 0;
+
+    actor_io_write(ctx->self, MSG_FILE_WRITTEN, file_fd, text("a file"), 10);
+}
+
+static void on_file_written(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    actor_io_read(ctx->self, MSG_FILE_READ, file_fd, 64, 10);
+}
+
+static void on_file_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+
+    actor_io_t *io = (actor_io_t *)data;
+    file_read_back = io->result == 6 && memcmp(io->data, "a file", 6) == 0;
+
+    actor_io_accept(ctx->self, MSG_ACCEPTED, listen_fd);
+}
+
+static void on_accepted(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+
+    actor_io_t *io = (actor_io_t *)data;
+    accepted = io->op == ACTOR_IO_ACCEPT && io->result >= 0;
+
+    if (io->result >= 0)
+        close((int)io->result);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    ctx_send(ctx, ctx->self, godie);
+}
+
+// nothing but the read is left, and what it waits for is written well after
+static void wait_hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    actor_io_read(ctx->self, MSG_WRITE, sv[0], 64, -1);
+}
+
+static void on_late_read(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+
+    actor_io_t *io = (actor_io_t *)data;
+    late_read = io->op == ACTOR_IO_READ && io->result == 4 && memcmp(io->data, "late", 4) == 0;
+}
+
+// writes once the system has been left with nothing but the read for a while
+static void *write_late(void *arg)
+{
+    (void)arg;
+
+    usleep(20 * 1000);
+    ssize_t n = write(sv[1], "late", 4);
+    (void)n;
+
+    return NULL;
+}
+
+static char *requests_complete_as_messages()
+{
+    mu_assert("socketpair", socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    char path[] = "/tmp/test_io_XXXXXX";
+    mu_assert("file", (file_fd = mkstemp(path)) >= 0);
+    unlink(path);
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    mu_assert("listen", listen_fd >= 0 && bind(listen_fd, (struct sockaddr *)&addr, len) == 0 && listen(listen_fd, 1) == 0);
+    mu_assert("port", getsockname(listen_fd, (struct sockaddr *)&addr, &len) == 0);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    config.min_workers = 1;
+    config.max_workers = 1;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+    mu_assert("start", actor_io_start() == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    mu_assert("connect", connect(client, (struct sockaddr *)&addr, len) == 0);
+
+    actor_system_join(a);
+    mu_assert("stop", actor_io_stop() == 0);
+
+    mu_assert("written", written);
+    mu_assert("read back", read_back);
+    mu_assert("file read back", file_read_back);
+    mu_assert("accepted", accepted);
+    mu_assert("nothing dropped", actor_io_dropped() == 0);
+    mu_assert("flags back", (fcntl(sv[0], F_GETFL) & O_NONBLOCK) == 0);
+
+    close(client);
+    close(listen_fd);
+    close(file_fd);
+    close(sv[0]);
+    close(sv[1]);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+// a quiescent system waits for the read instead of ending with it pending
+static char *quiescent_waits_for_io()
+{
+    mu_assert("socketpair", socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+    mu_assert("start", actor_io_start() == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &wait_role) == 0);
+
+    pthread_t writer;
+    mu_assert("writer", pthread_create(&writer, NULL, write_late, NULL) == 0);
+
+    actor_system_join(a);
+    pthread_join(writer, NULL);
+    mu_assert("stop", actor_io_stop() == 0);
+
+    mu_assert("late read", late_read);
+    mu_assert("nothing dropped", actor_io_dropped() == 0);
+    mu_assert("flags back", (fcntl(sv[0], F_GETFL) & O_NONBLOCK) == 0);
+
+    close(sv[0]);
+    close(sv[1]);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(requests_complete_as_messages);
+    mu_run_test(quiescent_waits_for_io);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,362 @@
+#include "minunit.h"
+#include "macierz.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// more columns than the legacy path handles, and than one real tile holds
+#define WIDE_COLS 4200
+// about 2 MiB of text, so that --jobs cuts it into several chunks
+#define BIG_ROWS 200
+#define BIG_COLS 1000
+
+int tests_run = 0;
+
+static char path[] = "/tmp/test_macierz_XXXXXX";
+static char bin_path[] = "/tmp/test_macierz_bin_XXXXXX";
+
+// the same matrix every time: values of both signs, a delay in every few cells
+static void fill(num_t k, num_t n, num_t *values, num_t *times, num_t *sums)
+{
+    unsigned long long seed = 42;
+
+    for (num_t row = 0; row < k; ++row)
+    {
+        sums[row] = 0;
+
+        for (num_t col = 0; col < n; ++col)
+        {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            values[row * n + col] = (num_t)(seed >> 40) % 2001 - 1000;
+            times[row * n + col] = col % 1500 == 7 ? 1 : 0;
+            sums[row] += values[row * n + col];
+        }
+    }
+}
+
+static int write_text(num_t k, num_t n, num_t const *values, num_t const *times)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+
+    fprintf(f, "%lld %lld\n", k, n);
+    for (num_t row = 0; row < k; ++row)
+    {
+        for (num_t col = 0; col < n; ++col)
+            fprintf(f, "%lld %lld ", values[row * n + col], times[row * n + col]);
+        fputc('\n', f);
+    }
+
+    return fclose(f);
+}
+
+static int write_file(char const *text)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+
+    fputs(text, f);
+    return fclose(f);
+}
+
+// runs the macierz program on the file at input; true if it printed the k sums
+// and exited with 0
+static bool run_macierz(char const *args, char const *input, num_t k, num_t const *sums)
+{
+    char command[256];
+    snprintf(command, sizeof(command), "%s %s < %s", MACIERZ_BIN, args, input);
+
+    FILE *out = popen(command, "r");
+    if (out == NULL)
+        return false;
+
+    bool same = true;
+    num_t sum;
+
+    for (num_t row = 0; row < k; ++row)
+        same = same && fscanf(out, "%lld", &sum) == 1 && sum == sums[row];
+
+    same = same && fscanf(out, "%lld", &sum) == EOF;
+
+    int status = pclose(out);
+    return same && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// test_macierz builds the tiles with TILE_COLS 16 and TILE_CELLS 64, so the
+// matrix here is cut into seven column chunks of three row bands
+static char *tiled_matches_legacy()
+{
+    num_t k = 10, n = 100;
+    num_t values[10 * 100], times[10 * 100], sums[10], tiled[10];
+    fill(k, n, values, times, sums);
+
+    mu_assert("tiled", macierz_tiled(k, n, values, times, tiled) == 0);
+    for (num_t row = 0; row < k; ++row)
+        mu_assert("tiled sums", tiled[row] == sums[row]);
+
+    mu_assert("write", write_text(k, n, values, times) == 0);
+    mu_assert("legacy", run_macierz("", path, k, sums));
+    mu_assert("--tiled", run_macierz("--tiled", path, k, sums));
+    return 0;
+}
+
+// with the real tile size too, a wide matrix is summed in more than one chunk
+static char *tiled_wide()
+{
+    num_t k = 3, n = WIDE_COLS;
+    num_t *values = malloc(sizeof(num_t) * k * n);
+    num_t *times = malloc(sizeof(num_t) * k * n);
+    num_t sums[3], tiled[3];
+    mu_assert("alloc", values != NULL && times != NULL);
+    fill(k, n, values, times, sums);
+
+    mu_assert("tiled", macierz_tiled(k, n, values, times, tiled) == 0);
+    for (num_t row = 0; row < k; ++row)
+        mu_assert("tiled sums", tiled[row] == sums[row]);
+
+    mu_assert("write", write_text(k, n, values, times) == 0);
+    mu_assert("--tiled", run_macierz("--tiled", path, k, sums));
+
+    free(values);
+    free(times);
+    return 0;
+}
+
+// how the macierz program exits on the file at input, its output thrown away
+static int exit_status(char const *args, char const *input)
+{
+    char command[256];
+    snprintf(command, sizeof(command), "%s %s < %s > /dev/null", MACIERZ_BIN, args, input);
+
+    int status = system(command);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// reads the file at input, or a pipe from it, with jobs threads
+static int read_input(char const *input, bool piped, int jobs, macierz_input_t *in)
+{
+    if (piped)
+    {
+        char command[256];
+        snprintf(command, sizeof(command), "cat %s", input);
+
+        FILE *pipe = popen(command, "r");
+        if (pipe == NULL)
+            return -1;
+
+        int check = macierz_input_read(fileno(pipe), jobs, in);
+        pclose(pipe);
+        return check;
+    }
+
+    FILE *f = fopen(input, "r");
+    if (f == NULL)
+        return -1;
+
+    int check = macierz_input_read(fileno(f), jobs, in);
+    fclose(f);
+    return check;
+}
+
+static bool same_input(macierz_input_t const *in, num_t k, num_t n, num_t const *values, num_t const *times)
+{
+    size_t cells = (size_t)k * (size_t)n;
+    return in->k == k && in->n == n && memcmp(in->values, values, sizeof(num_t) * cells) == 0 &&
+           memcmp(in->times, times, sizeof(num_t) * cells) == 0;
+}
+
+// more text than a read block, cut at line ends into one chunk per job
+static char *parse_in_chunks()
+{
+    num_t k = BIG_ROWS, n = BIG_COLS;
+    num_t *values = malloc(sizeof(num_t) * k * n);
+    num_t *times = malloc(sizeof(num_t) * k * n);
+    num_t *sums = malloc(sizeof(num_t) * k);
+    mu_assert("alloc", values != NULL && times != NULL && sums != NULL);
+    fill(k, n, values, times, sums);
+    mu_assert("write", write_text(k, n, values, times) == 0);
+
+    int jobs[] = {1, 2, 4};
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); ++i)
+    {
+        for (int piped = 0; piped < 2; ++piped)
+        {
+            macierz_input_t in;
+            mu_assert("read", read_input(path, piped, jobs[i], &in) == 0);
+            mu_assert("parsed", same_input(&in, k, n, values, times));
+            macierz_input_release(&in);
+        }
+    }
+
+    mu_assert("--fast --jobs", run_macierz("--fast --jobs 4 --tiled", path, k, sums));
+
+    free(values);
+    free(times);
+    free(sums);
+    return 0;
+}
+
+static bool rejects_text(char const *text)
+{
+    macierz_input_t in;
+    return write_file(text) == 0 && read_input(path, false, 2, &in) != 0 && read_input(path, true, 2, &in) != 0;
+}
+
+static bool rejects_binary(num_t k, num_t n, size_t cells)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return false;
+
+    fputs(MACIERZ_MAGIC, f);
+    fwrite(&k, sizeof(num_t), 1, f);
+    fwrite(&n, sizeof(num_t), 1, f);
+    for (size_t i = 0; i < 2 * cells; ++i)
+        fwrite(&k, sizeof(num_t), 1, f);
+    fclose(f);
+
+    macierz_input_t in;
+    return read_input(path, false, 1, &in) != 0 && read_input(path, true, 1, &in) != 0;
+}
+
+static char *malformed_rejected()
+{
+    mu_assert("empty", rejects_text(""));
+    mu_assert("no size", rejects_text("2\n"));
+    mu_assert("negative size", rejects_text("-1 2\n"));
+    mu_assert("short", rejects_text("2 2\n1 0 2 0\n3 0\n"));
+    mu_assert("long", rejects_text("1 2\n1 0 2 0\n3 0\n"));
+    mu_assert("garbage", rejects_text("1 2\n1 0 x 0\n"));
+    mu_assert("lone minus", rejects_text("1 1\n1 -\n"));
+    mu_assert("wrapping size", rejects_text("4294967296 4294967296\n"));
+
+    mu_assert("short binary", rejects_binary(2, 2, 3));
+    mu_assert("negative binary", rejects_binary(-1, 2, 0));
+    mu_assert("wrapping binary", rejects_binary((num_t)1 << 32, (num_t)1 << 32, 0));
+    mu_assert("header only", rejects_text(MACIERZ_MAGIC));
+
+    num_t sums[] = {2};
+    mu_assert("fine", write_file("1 2\n-5 0 7 0\n") == 0 && run_macierz("--fast", path, 1, sums));
+    mu_assert("--fast fails", write_file("1 2\n-5 0 7\n") == 0 && !run_macierz("--fast", path, 1, sums));
+    return 0;
+}
+
+// --to-binary writes what a binary read then uses in place
+static char *binary_round_trip()
+{
+    num_t k = 10, n = 100;
+    num_t values[10 * 100], times[10 * 100], sums[10];
+    fill(k, n, values, times, sums);
+    mu_assert("write", write_text(k, n, values, times) == 0);
+
+    macierz_input_t in;
+    mu_assert("read", read_input(path, false, 1, &in) == 0);
+    FILE *bin = fopen(bin_path, "w");
+    mu_assert("open", bin != NULL);
+    mu_assert("write binary", macierz_input_write_binary(bin, &in) == 0);
+    mu_assert("close", fclose(bin) == 0);
+    macierz_input_release(&in);
+
+    for (int piped = 0; piped < 2; ++piped)
+    {
+        mu_assert("read binary", read_input(bin_path, piped, 1, &in) == 0);
+        mu_assert("in place", in.base != NULL);
+        mu_assert("same", same_input(&in, k, n, values, times));
+        macierz_input_release(&in);
+    }
+
+    char command[256];
+    snprintf(command, sizeof(command), "%s --to-binary < %s > %s", MACIERZ_BIN, path, bin_path);
+    mu_assert("--to-binary", system(command) == 0);
+
+    mu_assert("binary read", read_input(bin_path, false, 1, &in) == 0);
+    mu_assert("binary same", same_input(&in, k, n, values, times));
+    macierz_input_release(&in);
+
+    mu_assert("--fast binary", run_macierz("--fast", bin_path, k, sums));
+    mu_assert("--fast --tiled binary", run_macierz("--fast --tiled", bin_path, k, sums));
+    return 0;
+}
+
+// the rows reuse window slots, so with a window smaller than k a row has to
+// wait for the one window rows back to be printed
+static char *stream_in_order()
+{
+    num_t k = 10, n = 100;
+    num_t values[10 * 100], times[10 * 100], sums[10];
+    fill(k, n, values, times, sums);
+    mu_assert("write", write_text(k, n, values, times) == 0);
+
+    mu_assert("window 1", run_macierz("--stream --window 1", path, k, sums));
+    mu_assert("window 3", run_macierz("--stream --window 3", path, k, sums));
+    mu_assert("window above k", run_macierz("--stream --window 64", path, k, sums));
+    mu_assert("default window", run_macierz("--stream", path, k, sums));
+    return 0;
+}
+
+static char *stream_truncated()
+{
+    mu_assert("mid row", write_file("3 2\n1 0 2 0\n3 0 4 0\n5 0\n") == 0);
+    mu_assert("mid row fails", exit_status("--stream --window 2", path) != 0);
+    mu_assert("mid row, wide window", exit_status("--stream --window 8", path) != 0);
+
+    mu_assert("rows missing", write_file("3 2\n1 0 2 0\n") == 0);
+    mu_assert("rows missing fails", exit_status("--stream --window 1", path) != 0);
+
+    mu_assert("header only", write_file("3 2\n") == 0);
+    mu_assert("header only fails", exit_status("--stream", path) != 0);
+
+    mu_assert("no header", write_file("3\n") == 0);
+    mu_assert("no header fails", exit_status("--stream", path) != 0);
+
+    mu_assert("whole", write_file("3 2\n1 0 2 0\n3 0 4 0\n5 0 6 0\n") == 0);
+    mu_assert("no window", exit_status("--stream --window 0", path) != 0);
+    mu_assert("whole passes", exit_status("--stream --window 2", path) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(tiled_matches_legacy);
+    mu_run_test(tiled_wide);
+    mu_run_test(parse_in_chunks);
+    mu_run_test(malformed_rejected);
+    mu_run_test(binary_round_trip);
+    mu_run_test(stream_in_order);
+    mu_run_test(stream_truncated);
+    return 0;
+}
+
+int main()
+{
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 1;
+    close(fd);
+
+    if ((fd = mkstemp(bin_path)) < 0)
+        return 1;
+    close(fd);
+
+    char *result = all_tests();
+    unlink(path);
+    unlink(bin_path);
+
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,426 @@
+#include "minunit.h"
+#include "cacti_net.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MSG_PING (message_type_t)1
+#define MSG_NOTE (message_type_t)2
+#define MSG_PONG (message_type_t)3
+#define MSG_START (message_type_t)4
+#define MSG_RAW (message_type_t)5
+#define MSG_SLOW (message_type_t)6
+#define MSG_FLOOD (message_type_t)7
+#define MSG_BIG (message_type_t)8
+#define MSG_FLOOD_START (message_type_t)9
+#define MSG_TALLY (message_type_t)10
+
+#define NODES 3
+#define PINGS 1000
+// more than fit the remote mailbox, each answered with more than the connection
+// buffers before the connection refuses further answers
+#define FLOODS 2000
+#define BIG (16 << 10)
+// what a connecting node sends first, as the wire has it
+#define HELLO_MAGIC 0x54454e4954434143ULL
+
+int tests_run = 0;
+
+// a payload with a pointer in it, which only its serializer can carry
+typedef struct note
+{
+    long n;
+    char const *text;
+} note_t;
+
+static size_t note_size(size_t nbytes, void const *data)
+{
+    (void)nbytes;
+    return sizeof(long) + strlen(((note_t const *)data)->text);
+}
+
+static void note_encode(size_t nbytes, void const *data, void *out)
+{
+    (void)nbytes;
+    note_t const *note = (note_t const *)data;
+    memcpy(out, &note->n, sizeof(long));
+    memcpy((char *)out + sizeof(long), note->text, strlen(note->text));
+}
+
+static actor_buffer_t *note_decode(void const *bytes, size_t length)
+{
+    size_t len = length - sizeof(long);
+    actor_buffer_t *buffer = buffer_create(sizeof(note_t) + len + 1);
+    if (buffer == NULL)
+        return NULL;
+
+    note_t *note = (note_t *)buffer_data(buffer);
+    char *text = (char *)(note + 1);
+    memcpy(&note->n, bytes, sizeof(long));
+    memcpy(text, (char const *)bytes + sizeof(long), len);
+    text[len] = '\0';
+    note->text = text;
+    return buffer;
+}
+
+static actor_serializer_t const note_serializer = {note_size, note_encode, note_decode};
+
+static long pongs;
+static long sum;
+static long bigs;
+// answers the sink got out and had refused, and what it reported of them
+static long accepted;
+static long refused;
+static long tally_accepted = -1;
+static long tally_refused = -1;
+static char big_payload[BIG];
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void ping(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    long value = *(long *)data + 1;
+    message_t pong = {MSG_PONG, nbytes, &value};
+    ctx_reply(ctx, pong);
+}
+
+static void note(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    note_t *note = (note_t *)data;
+    long value = note->n + (long)strlen(note->text);
+    message_t pong = {MSG_PONG, sizeof(long), &value};
+    ctx_reply(ctx, pong);
+}
+
+static void pong(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    sum += *(long *)data;
+
+    if (++pongs == (NODES - 1) * (PINGS + 1))
+    {
+        message_t godie = {MSG_GODIE, 0, NULL};
+        for (int node = 1; node < NODES; ++node)
+            ctx_send(ctx, actor_node_id(node, 0), godie);
+        ctx_send(ctx, ctx->self, godie);
+    }
+}
+
+static void start(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    for (int node = 1; node < NODES; ++node)
+    {
+        actor_id_t echo = actor_node_id(node, 0);
+
+        for (long i = 0; i < PINGS; ++i)
+        {
+            message_t msg = {MSG_PING, sizeof(long), &i};
+            ctx_send(ctx, echo, msg);
+        }
+
+        note_t n = {100, "pointer"};
+        message_t msg = {MSG_NOTE, sizeof(note_t), &n};
+        ctx_send(ctx, echo, msg);
+    }
+}
+
+// the floods pile up in the mailbox behind it
+static void slow(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    usleep(50 * 1000);
+}
+
+static void flood(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    message_t reply = {MSG_BIG, BIG, big_payload};
+    if (ctx_reply(ctx, reply) == 0)
+        ++accepted;
+    else
+        ++refused;
+
+    if (accepted + refused < FLOODS)
+        return;
+
+    // comes after every accepted answer on the same connection, once there is room
+    long counts[2] = {accepted, refused};
+    message_t msg = {MSG_TALLY, sizeof(counts), counts};
+    while (ctx_reply(ctx, msg) != 0)
+        usleep(1000);
+}
+
+static void big(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)data;
+
+    if (nbytes == BIG)
+        ++bigs;
+}
+
+static void tally(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    tally_accepted = ((long *)data)[0];
+    tally_refused = ((long *)data)[1];
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    ctx_send(ctx, actor_node_id(1, 0), godie);
+    ctx_send(ctx, ctx->self, godie);
+}
+
+static void flood_start(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    actor_id_t sink = actor_node_id(1, 0);
+    message_t msg = {MSG_SLOW, 0, NULL};
+    ctx_send(ctx, sink, msg);
+
+    message_t next = {MSG_FLOOD, 0, NULL};
+    for (int i = 0; i < FLOODS; ++i)
+        ctx_send(ctx, sink, next);
+}
+
+static act_ctx_t prompts[] = {hello, ping, note, pong, start, hello, slow, flood, big, flood_start, tally};
+static role_ctx_t role = {11, prompts};
+
+static int echo_process(int node, int report)
+{
+    uint16_t port = 0;
+    actor_id_t echo;
+
+    if (actor_net_start(node) != 0 || actor_net_listen("127.0.0.1", &port) != 0)
+        return 1;
+
+    if (actor_system_create_ctx(&echo, &role) != 0 || echo != 0)
+        return 1;
+
+    if (write(report, &port, sizeof(port)) != sizeof(port))
+        return 1;
+
+    actor_system_join(echo);
+    return actor_net_stop() == 0 ? 0 : 1;
+}
+
+static char *three_nodes()
+{
+    mu_assert("ping", actor_net_serializer(MSG_PING, &actor_serializer_flat) == 0);
+    mu_assert("pong", actor_net_serializer(MSG_PONG, &actor_serializer_flat) == 0);
+    mu_assert("note", actor_net_serializer(MSG_NOTE, &note_serializer) == 0);
+
+    pid_t children[NODES];
+    uint16_t ports[NODES];
+
+    for (int node = 1; node < NODES; ++node)
+    {
+        int report[2];
+        mu_assert("pipe", pipe(report) == 0);
+
+        children[node] = fork();
+        mu_assert("fork", children[node] >= 0);
+
+        if (children[node] == 0)
+            _exit(echo_process(node, report[1]));
+
+        mu_assert("port", read(report[0], &ports[node], sizeof(uint16_t)) == sizeof(uint16_t));
+        close(report[0]);
+        close(report[1]);
+    }
+
+    mu_assert("start", actor_net_start(0) == 0);
+    for (int node = 1; node < NODES; ++node)
+        mu_assert("connect", actor_net_connect(node, "127.0.0.1", ports[node]) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    long raw = 0;
+    message_t raw_msg = {MSG_RAW, sizeof(long), &raw};
+    mu_assert("no serializer", send_message(actor_node_id(1, 0), raw_msg) != 0);
+
+    message_t start_msg = {MSG_START, 0, NULL};
+    mu_assert("send", send_message(a, start_msg) == 0);
+    actor_system_join(a);
+
+    mu_assert("pongs", pongs == (NODES - 1) * (PINGS + 1));
+    mu_assert("sum", sum == (NODES - 1) * ((long)PINGS * (PINGS + 1) / 2 + 107));
+
+    for (int node = 1; node < NODES; ++node)
+    {
+        int status;
+        mu_assert("wait", waitpid(children[node], &status, 0) == children[node]);
+        mu_assert("echo process", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    mu_assert("stop", actor_net_stop() == 0);
+    mu_assert("nothing dropped", actor_net_dropped() == 0);
+    return 0;
+}
+
+static pid_t spawn_node(int node, uint16_t *port)
+{
+    int report[2];
+    if (pipe(report) != 0)
+        return -1;
+
+    pid_t child = fork();
+
+    if (child == 0)
+        _exit(echo_process(node, report[1]));
+
+    if (child > 0 && read(report[0], port, sizeof(uint16_t)) != sizeof(uint16_t))
+        child = -1;
+
+    close(report[0]);
+    close(report[1]);
+    return child;
+}
+
+// the remote mailbox fills up while the actor behind it answers through the same
+// connection; the remote I/O thread has to keep writing the answers out, and the
+// answers it has no room for are refused to the sender rather than blocking it
+static char *full_mailbox()
+{
+    mu_assert("big", actor_net_serializer(MSG_BIG, &actor_serializer_flat) == 0);
+    mu_assert("tally", actor_net_serializer(MSG_TALLY, &actor_serializer_flat) == 0);
+
+    uint16_t port;
+    pid_t child = spawn_node(1, &port);
+    mu_assert("fork", child > 0);
+
+    mu_assert("start", actor_net_start(0) == 0);
+    mu_assert("connect", actor_net_connect(1, "127.0.0.1", port) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_FLOOD_START, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+    actor_system_join(a);
+
+    mu_assert("all accounted for", tally_accepted + tally_refused == FLOODS);
+    mu_assert("accepted answers arrived", bigs == tally_accepted);
+    mu_assert("some answered", bigs > 0);
+
+    int status;
+    mu_assert("wait", waitpid(child, &status, 0) == child);
+    mu_assert("sink process", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    mu_assert("stop", actor_net_stop() == 0);
+    mu_assert("nothing dropped", actor_net_dropped() == 0);
+    return 0;
+}
+
+// connects like a node would and says hello as node; returns the socket
+static int raw_hello(uint16_t port, uint64_t node)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    uint64_t hello[2] = {htobe64(HELLO_MAGIC), htobe64(node)};
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        write(fd, hello, sizeof(hello)) != sizeof(hello))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// whether the other end closed fd within timeout_ms
+static bool closed_within(int fd, int timeout_ms)
+{
+    struct pollfd p = {fd, POLLIN, 0};
+    char byte;
+    return poll(&p, 1, timeout_ms) == 1 && read(fd, &byte, 1) == 0;
+}
+
+// a hello claiming this node, or a node that is connected already, would steal
+// the route of the connection that works; the node closes those instead
+static char *hello_checked()
+{
+    uint16_t port = 0;
+    mu_assert("start", actor_net_start(0) == 0);
+    mu_assert("listen", actor_net_listen("127.0.0.1", &port) == 0);
+
+    int self = raw_hello(port, 0);
+    mu_assert("connect self", self >= 0);
+    mu_assert("self refused", closed_within(self, 1000));
+
+    int first = raw_hello(port, 5);
+    mu_assert("connect first", first >= 0);
+    int second = raw_hello(port, 5);
+    mu_assert("connect second", second >= 0);
+    mu_assert("second refused", closed_within(second, 1000));
+    mu_assert("first kept", !closed_within(first, 50));
+
+    close(self);
+    close(second);
+    close(first);
+    mu_assert("stop", actor_net_stop() == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(three_nodes);
+    mu_run_test(full_mailbox);
+    mu_run_test(hello_checked);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,206 @@
+#include "minunit.h"
+#include "cacti_par.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MSG_RUN (message_type_t)1
+
+int tests_run = 0;
+
+static _Atomic long visits[1000];
+static bool handler_ok = false;
+
+static void visit(size_t begin, size_t end, void *arg)
+{
+    (void)arg;
+
+    for (size_t i = begin; i < end; ++i)
+        ++visits[i];
+}
+
+static void square(size_t i, void *out, void *arg)
+{
+    (void)arg;
+    *(long *)out = (long)(i * i);
+}
+
+typedef struct span
+{
+    size_t begin;
+    size_t end;
+    bool ordered;
+} span_t;
+
+static void span_leaf(size_t begin, size_t end, void *value, void *arg)
+{
+    (void)arg;
+    span_t *span = (span_t *)value;
+    span->begin = begin;
+    span->end = end;
+    span->ordered = true;
+}
+
+// only adjacent spans in index order may meet
+static void span_combine(void *acc, void *other, void *arg)
+{
+    (void)arg;
+    span_t *left = (span_t *)acc;
+    span_t *right = (span_t *)other;
+    left->ordered = left->ordered && right->ordered && left->end == right->begin;
+    left->end = right->end;
+}
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+// the helpers run on the system this handler belongs to
+static void run(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    long out[300];
+    span_t span = {0, 0, false};
+
+    handler_ok = actor_map(0, 300, 0, sizeof(long), out, square, NULL) == 0
+        && actor_reduce(0, 500, 9, sizeof(span_t), &span, span_leaf, span_combine, NULL) == 0
+        && span.ordered && span.begin == 0 && span.end == 500;
+
+    for (size_t i = 0; i < 300; ++i)
+        handler_ok = handler_ok && out[i] == (long)(i * i);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    ctx_send(ctx, ctx->self, godie);
+}
+
+// every outer chunk runs helpers of its own on the same workers
+static void nested(size_t begin, size_t end, void *arg)
+{
+    (void)arg;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (actor_parallel_for(i * 100, (i + 1) * 100, 10, visit, NULL) != 0)
+            return;
+    }
+}
+
+static act_ctx_t prompts[] = {hello, run};
+static role_ctx_t role = {2, prompts};
+
+static char *parallel_for_visits_once()
+{
+    mu_assert("for", actor_parallel_for(10, 1000, 0, visit, NULL) == 0);
+
+    for (size_t i = 0; i < 1000; ++i)
+        mu_assert("visited once", visits[i] == (i < 10 ? 0 : 1));
+
+    return 0;
+}
+
+static char *map_fills_in_place()
+{
+    long out[500];
+    mu_assert("map", actor_map(100, 600, 7, sizeof(long), out, square, NULL) == 0);
+
+    for (size_t i = 0; i < 500; ++i)
+        mu_assert("square", out[i] == (long)((i + 100) * (i + 100)));
+
+    return 0;
+}
+
+static char *reduce_keeps_order()
+{
+    // 38 chunks of 26 or 27 leave empty leaves in a 64 leaf tree
+    span_t span = {0, 0, false};
+    mu_assert("reduce", actor_reduce(3, 1003, 27, sizeof(span_t), &span, span_leaf, span_combine, NULL) == 0);
+    mu_assert("ordered", span.ordered);
+    mu_assert("covered", span.begin == 3 && span.end == 1003);
+
+    span_t untouched = {1, 2, false};
+    mu_assert("empty", actor_reduce(5, 5, 0, sizeof(span_t), &untouched, span_leaf, span_combine, NULL) == 0);
+    mu_assert("left alone", untouched.begin == 1 && untouched.end == 2);
+    return 0;
+}
+
+static char *inside_a_handler()
+{
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_RUN, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+    actor_system_join(a);
+
+    mu_assert("handler results", handler_ok);
+    return 0;
+}
+
+static char *alongside_a_system()
+{
+    for (size_t i = 0; i < 1000; ++i)
+        visits[i] = 0;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("running", actor_system_running());
+
+    mu_assert("for", actor_parallel_for(0, 1000, 0, visit, NULL) == 0);
+
+    message_t godie = {MSG_GODIE, 0, NULL};
+    mu_assert("godie", send_message(a, godie) == 0);
+    actor_system_join(a);
+    mu_assert("ended", !actor_system_running());
+
+    for (size_t i = 0; i < 1000; ++i)
+        mu_assert("visited once", visits[i] == 1);
+
+    return 0;
+}
+
+static char *nested_calls()
+{
+    for (size_t i = 0; i < 1000; ++i)
+        visits[i] = 0;
+
+    mu_assert("nested", actor_parallel_for(0, 10, 1, nested, NULL) == 0);
+
+    for (size_t i = 0; i < 1000; ++i)
+        mu_assert("visited once", visits[i] == 1);
+
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(parallel_for_visits_once);
+    mu_run_test(map_fills_in_place);
+    mu_run_test(reduce_keeps_order);
+    mu_run_test(inside_a_handler);
+    mu_run_test(alongside_a_system);
+    mu_run_test(nested_calls);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
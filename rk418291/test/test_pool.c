@@ -0,0 +1,488 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_COUNT (message_type_t)1
+#define MSG_WORK (message_type_t)2
+#define MSG_TICK (message_type_t)3
+#define MSG_SERVE (message_type_t)4
+#define MSG_FAN (message_type_t)5
+#define MSG_JOINED (message_type_t)6
+#define MSG_BOUNCE (message_type_t)7
+#define MSG_PARK (message_type_t)8
+#define MSG_HOLD (message_type_t)9
+#define MSG_SPLIT (message_type_t)10
+
+#define BULK_ACTORS 50
+#define BULK_TICKS 20
+#define INTERACTIVE_TICKS 10
+#define SERVES 40
+#define BOUNCES 2000
+// how many woken actors a worker runs in a row before it serves the thread queue
+#define RUN_NEXT_LIMIT 64
+
+int tests_run = 0;
+
+static _Atomic long counted = 0;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void count(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++counted;
+}
+
+static void work(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    usleep(5 * 1000);
+    ++counted;
+}
+
+static long ticks;
+static long interactive_ticks;
+static long interactive_done_at;
+
+static void tick(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++ticks;
+
+    if (ctx->self == 0 && ++interactive_ticks == INTERACTIVE_TICKS)
+        interactive_done_at = ticks;
+}
+
+static _Atomic int serving;
+static _Atomic int most_serving;
+
+static void serve(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    int now = ++serving;
+    int most = most_serving;
+    while (now > most && !atomic_compare_exchange_weak(&most_serving, &most, now))
+        ;
+
+    usleep(5 * 1000);
+    --serving;
+    ++counted;
+}
+
+// a reentrant actor's messages to itself go to whichever of its workers is free
+static void fan(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    message_t msg = {MSG_SERVE, 0, NULL};
+    for (int i = 0; i < SERVES; ++i)
+        ctx_send(ctx, ctx->self, msg);
+}
+
+static act_ctx_t prompts[] = {hello, count, work, tick, serve, fan};
+static role_ctx_t role = {6, prompts};
+
+// two actors the root spawns, and what it does with them once both said hello
+static actor_id_t pair[2];
+static _Atomic int announced;
+static _Atomic int paired;
+static void (*on_paired)(actor_ctx_t *ctx);
+
+static void announce(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    if (nbytes == 0)
+        return;
+
+    pair[announced++] = ctx->self;
+
+    message_t msg = {MSG_JOINED, 0, NULL};
+    ctx_send(ctx, *(actor_id_t *)data, msg);
+}
+
+static void joined(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (++paired == 2 && on_paired != NULL)
+        on_paired(ctx);
+}
+
+static long bounces;
+// bounces since another actor had a turn, and the most of them while one waited
+static long streak;
+static long longest_streak;
+static long ticks_done_at;
+
+static void bounce(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++bounces;
+
+    if (ticks < BULK_ACTORS * BULK_TICKS && ++streak > longest_streak)
+        longest_streak = streak;
+
+    if (bounces < BOUNCES)
+    {
+        message_t msg = {MSG_BOUNCE, 0, NULL};
+        ctx_send(ctx, ctx->self == pair[0] ? pair[1] : pair[0], msg);
+    }
+}
+
+static void bulk_tick(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    streak = 0;
+
+    if (++ticks == BULK_ACTORS * BULK_TICKS)
+        ticks_done_at = bounces;
+}
+
+static void start_bounce(actor_ctx_t *ctx)
+{
+    message_t msg = {MSG_BOUNCE, 0, NULL};
+    ctx_send(ctx, pair[0], msg);
+}
+
+static pthread_t root_thread;
+static pthread_t park_thread;
+static pthread_t hold_thread;
+static _Atomic bool parked;
+static bool held_through;
+
+static void park(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    park_thread = pthread_self();
+    parked = true;
+}
+
+// keeps its worker busy until the actor it pushed out ran somewhere else
+static void hold(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    hold_thread = pthread_self();
+
+    for (int i = 0; i < 1000 && !parked; ++i)
+        usleep(1000);
+    held_through = parked;
+}
+
+// the second send takes the first one's place as the worker's next actor
+static void split(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    root_thread = pthread_self();
+
+    message_t msg = {MSG_PARK, 0, NULL};
+    ctx_send(ctx, pair[0], msg);
+    msg.message_type = MSG_HOLD;
+    ctx_send(ctx, pair[1], msg);
+}
+
+static act_ctx_t handoff_prompts[] = {announce, count, work, bulk_tick, serve, fan, joined, bounce, park, hold, split};
+static role_ctx_t handoff_role = {11, handoff_prompts};
+
+static char *spawn_pair(actor_id_t *root, void (*then)(actor_ctx_t *ctx))
+{
+    announced = paired = 0;
+    on_paired = then;
+    mu_assert("create", actor_system_create_ctx(root, &handoff_role) == 0);
+
+    message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &handoff_role};
+    mu_assert("spawn", send_message(*root, spawn) == 0);
+    mu_assert("spawn", send_message(*root, spawn) == 0);
+    return 0;
+}
+
+static char *run_system(long messages)
+{
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_COUNT, 0, NULL};
+    for (long i = 0; i < messages; ++i)
+        mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    return 0;
+}
+
+static char *warm_pool()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.warm_pool = true;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    counted = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        char *result = run_system(10);
+        if (result != 0)
+            return result;
+    }
+    mu_assert("counted", counted == 2000);
+
+    mu_assert("destroy", actor_pool_destroy() == 0);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *elastic_pool()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("retires by default", config.idle_retire_ms > 0);
+    config.min_workers = 1;
+    config.max_workers = 8;
+    config.idle_retire_ms = 20;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("min workers", actor_pool_workers() == 1);
+
+    message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+    for (int i = 0; i < 16; ++i)
+        mu_assert("spawn", send_message(a, spawn) == 0);
+
+    usleep(10 * 1000);
+
+    counted = 0;
+    message_t msg = {MSG_WORK, 0, NULL};
+    for (int round = 0; round < 4; ++round)
+        for (actor_id_t child = 1; child <= 16; ++child)
+            mu_assert("send", send_message(child, msg) == 0);
+
+    int peak = 1;
+    while (counted < 64)
+    {
+        int workers = actor_pool_workers();
+        if (workers > peak)
+            peak = workers;
+        usleep(1000);
+    }
+    mu_assert("grown", peak > 1);
+
+    usleep(100 * 1000);
+    mu_assert("retired", actor_pool_workers() == 1);
+
+    actor_system_join(a);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+// one worker, fifty busy actors and one with a few messages queued behind them
+static long run_weighted(unsigned weight)
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.executor = ACTOR_EXECUTOR_INLINE;
+    if (actor_system_configure(&config) != 0)
+        return -1;
+
+    actor_id_t a, bulk;
+    actor_group_config_t group = {ACTOR_GROUP_ROUND_ROBIN, BULK_ACTORS, NULL};
+    if (actor_system_create_ctx(&a, &role) != 0 || actor_group_create(&bulk, &role, &group) != 0)
+        return -1;
+
+    ticks = interactive_ticks = interactive_done_at = 0;
+
+    message_t msg = {MSG_TICK, 0, NULL};
+    for (int i = 0; i < BULK_ACTORS * BULK_TICKS; ++i)
+        send_message(bulk, msg);
+    for (int i = 0; i < INTERACTIVE_TICKS; ++i)
+        send_message(a, msg);
+
+    actor_weight(a, weight);
+    actor_system_join(a);
+
+    actor_config_default(&config);
+    actor_system_configure(&config);
+    return ticks == BULK_ACTORS * BULK_TICKS + INTERACTIVE_TICKS ? interactive_done_at : -1;
+}
+
+static char *weighted_turns()
+{
+    long fair = run_weighted(ACTOR_WEIGHT_DEFAULT);
+    mu_assert("round robin", fair >= BULK_ACTORS * (INTERACTIVE_TICKS - 1));
+
+    long weighted = run_weighted(64);
+    mu_assert("all handled", weighted > 0);
+    mu_assert("weighted first", weighted < 2 * INTERACTIVE_TICKS);
+    return 0;
+}
+
+// one worker: two actors wake each other, and fifty busy ones wait for turns
+static char *handoff_chain()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.executor = ACTOR_EXECUTOR_INLINE;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t root, bulk;
+    char *result = spawn_pair(&root, start_bounce);
+    if (result != 0)
+        return result;
+
+    actor_group_config_t group = {ACTOR_GROUP_ROUND_ROBIN, BULK_ACTORS, NULL};
+    mu_assert("group", actor_group_create(&bulk, &handoff_role, &group) == 0);
+
+    ticks = bounces = streak = longest_streak = 0;
+    ticks_done_at = -1;
+
+    message_t msg = {MSG_TICK, 0, NULL};
+    for (int i = 0; i < BULK_ACTORS * BULK_TICKS; ++i)
+        mu_assert("send", send_message(bulk, msg) == 0);
+
+    actor_system_join(root);
+
+    mu_assert("all bounced", bounces == BOUNCES);
+    mu_assert("all ticked", ticks == BULK_ACTORS * BULK_TICKS);
+    mu_assert("woken runs next", longest_streak > 1);
+    mu_assert("handoffs bounded", longest_streak <= RUN_NEXT_LIMIT + 1);
+    mu_assert("bulk not starved", ticks_done_at >= 0 && ticks_done_at < BOUNCES / 2);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+// the actor a second wakeup pushes out of the worker's slot goes to the thread
+// queue, where the other worker picks it up
+static char *displaced_stolen()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.min_workers = 2;
+    config.max_workers = 2;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    parked = held_through = false;
+
+    actor_id_t root;
+    char *result = spawn_pair(&root, NULL);
+    if (result != 0)
+        return result;
+
+    // the pair has to be idle, so that both sends wake it
+    while (paired < 2)
+        usleep(1000);
+    usleep(20 * 1000);
+
+    message_t msg = {MSG_SPLIT, 0, NULL};
+    mu_assert("send", send_message(root, msg) == 0);
+    actor_system_join(root);
+
+    mu_assert("woken runs on its waker's worker", pthread_equal(hold_thread, root_thread));
+    mu_assert("displaced one stolen", held_through && !pthread_equal(park_thread, root_thread));
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *reentrant_actor()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    config.min_workers = 4;
+    config.max_workers = 4;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("reentrant", actor_reentrant(a) == 0);
+    mu_assert("not suspendable", actor_suspendable(a) != 0);
+
+    counted = 0;
+    message_t msg = {MSG_FAN, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    mu_assert("all served", counted == SERVES);
+    mu_assert("in parallel", most_serving > 1 && most_serving <= 4);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(warm_pool);
+    mu_run_test(elastic_pool);
+    mu_run_test(weighted_turns);
+    mu_run_test(handoff_chain);
+    mu_run_test(displaced_stolen);
+    mu_run_test(reentrant_actor);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
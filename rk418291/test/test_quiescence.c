@@ -0,0 +1,247 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_CHAIN (message_type_t)1
+#define MSG_COUNT (message_type_t)2
+#define MSG_TRACE (message_type_t)3
+#define MSG_FLOOD (message_type_t)4
+
+#define TRACED 6
+#define SELF_TAG 1000
+#define FLOOD 1500
+
+int tests_run = 0;
+
+static _Atomic long visited = 0;
+static _Atomic long counted = 0;
+static _Atomic bool in_order = true;
+static _Atomic bool tracing = false;
+static size_t trace[TRACED + 1];
+static int traced = 0;
+static _Atomic long flood_failed = 0;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void chain(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void count(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void trace_one(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+static void flood(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+
+static act_ctx_t prompts[] = {hello, chain, count, trace_one, flood};
+static role_ctx_t role = {5, prompts};
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (ctx->sender != ACTOR_ID_NONE)
+    {
+        message_t msg = {MSG_CHAIN, 0, NULL};
+        ctx_reply(ctx, msg);
+    }
+}
+
+static void chain(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    if (++visited < 1000)
+    {
+        message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+        ctx_send(ctx, ctx->self, spawn);
+    }
+}
+
+// sends to itself two at a time, so the self queue holds more than one message
+static void count(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    if ((long)nbytes != counted++)
+        in_order = false;
+
+    if (nbytes % 2 == 0 && nbytes < 10000)
+    {
+        message_t first = {MSG_COUNT, nbytes + 1, NULL};
+        message_t second = {MSG_COUNT, nbytes + 2, NULL};
+        ctx_send(ctx, ctx->self, first);
+        send_message(ctx->self, second);
+    }
+}
+
+// the first one waits for the rest to queue up, then sends itself one more
+static void trace_one(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    if (traced <= TRACED)
+        trace[traced++] = nbytes;
+
+    if (nbytes == 0)
+    {
+        tracing = true;
+        usleep(20 * 1000);
+
+        message_t msg = {MSG_TRACE, SELF_TAG, NULL};
+        ctx_send(ctx, ctx->self, msg);
+    }
+}
+
+// more than one queue's worth sent to itself at once
+static void flood(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)data;
+
+    if (nbytes > 0)
+    {
+        if ((long)nbytes != ++counted)
+            in_order = false;
+        return;
+    }
+
+    for (size_t i = 1; i <= FLOOD; ++i)
+    {
+        message_t msg = {MSG_FLOOD, i, NULL};
+        if (ctx_send(ctx, ctx->self, msg) != 0)
+            ++flood_failed;
+    }
+}
+
+static char *ends_without_godie()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_CHAIN, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    mu_assert("visited", visited == 1000);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *self_sends_in_order()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_COUNT, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    mu_assert("counted", counted == 10001);
+    mu_assert("in order", in_order);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+// what the actor sends itself goes behind what was already in its mailbox
+static char *self_sends_behind_mailbox()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_TRACE, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    while (!tracing)
+        usleep(100);
+
+    for (size_t i = 1; i < TRACED; ++i)
+    {
+        message_t next = {MSG_TRACE, i, NULL};
+        mu_assert("send", send_message(a, next) == 0);
+    }
+
+    actor_system_join(a);
+    mu_assert("traced", traced == TRACED + 1);
+
+    for (size_t i = 0; i < TRACED; ++i)
+        mu_assert("mailbox first", trace[i] == i);
+    mu_assert("self last", trace[TRACED] == SELF_TAG);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *self_sends_spill_into_mailbox()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    counted = 0;
+    in_order = true;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_FLOOD, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    mu_assert("all sent", flood_failed == 0);
+    mu_assert("all handled", counted == FLOOD);
+    mu_assert("in order", in_order);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(ends_without_godie);
+    mu_run_test(self_sends_in_order);
+    mu_run_test(self_sends_behind_mailbox);
+    mu_run_test(self_sends_spill_into_mailbox);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,134 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FANOUT 4
+// an idle actor is a slab record and its table slot, about 250 B of resident
+// memory with glibc on x86-64; a full record with its mailbox took over 400.
+// Resident memory also counts allocator and page slack, which varies with the
+// libc and the kernel, so the bound only has to tell the two layouts apart.
+#define BYTES_PER_ACTOR 384
+
+int tests_run = 0;
+
+// spawns promised so far; the root's own hello counts as the first
+static _Atomic long reserved = 1;
+static _Atomic long greeted = 0;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data);
+
+static act_ctx_t prompts[] = {hello};
+static role_ctx_t role = {1, prompts};
+
+// every new actor spawns a few more until there is one for every id
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    for (int i = 0; i < FANOUT; ++i)
+    {
+        if (reserved++ >= CAST_LIMIT)
+            break;
+
+        message_t spawn = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+        ctx_send(ctx, ctx->self, spawn);
+    }
+
+    ++greeted;
+}
+
+static double seconds_since(struct timespec const *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static long resident_kb()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm == NULL)
+        return -1;
+
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = -1;
+
+    fclose(statm);
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static char *cast_limit_actors()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    long before = resident_kb();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    while (greeted < CAST_LIMIT)
+        usleep(1000);
+
+    double spawn = seconds_since(&start);
+    long after = resident_kb();
+    long per_actor = (after - before) * 1024 / CAST_LIMIT;
+
+    printf(__FILE__ ": %d actors, rss %ld KiB before, %ld KiB after (%ld B per actor), spawn %.3f s\n",
+           CAST_LIMIT, before, after, per_actor, spawn);
+    mu_assert("resident", before >= 0 && after >= 0);
+    mu_assert("compact", per_actor <= BYTES_PER_ACTOR);
+
+    // every id is taken, so one more spawn is refused
+    future_t f;
+    message_t extra = {MSG_SPAWN_CTX, sizeof(role_ctx_t), &role};
+    mu_assert("ask", ask(a, extra, &f) == 0);
+    mu_assert("refused", future_wait(&f, NULL) == FUTURE_BROKEN);
+    future_destroy(&f);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    actor_system_join(a);
+    double teardown = seconds_since(&start);
+
+    printf(__FILE__ ": teardown %.3f s\n", teardown);
+    mu_assert("all greeted", greeted == CAST_LIMIT);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(cast_limit_actors);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
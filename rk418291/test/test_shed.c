@@ -0,0 +1,160 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define MSG_SLOW (message_type_t)1
+#define MSG_WORK (message_type_t)2
+#define MSG_LATE (message_type_t)3
+
+#define WORKS 20
+#define DEPTH 4
+
+int tests_run = 0;
+
+static _Atomic long handled = 0;
+static _Atomic long expired = 0;
+static _Atomic bool slowed = false;
+static _Atomic bool released = false;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void slow(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    slowed = true;
+    while (!released)
+        usleep(100);
+}
+
+static void work(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++handled;
+}
+
+// half the work is past its deadline before it is even sent, the other half has a minute
+static void late(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+
+    message_t job = {MSG_WORK, 0, NULL};
+    for (int i = 0; i < WORKS; ++i)
+    {
+        ctx_send_within(ctx, ctx->self, job, -1);
+        ctx_send_within(ctx, ctx->self, job, 60 * 1000);
+    }
+}
+
+static void on_expired(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    ++expired;
+}
+
+static act_ctx_t prompts[] = {hello, slow, work, late};
+static role_ctx_t role = {4, prompts};
+
+static char *past_deadline()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    handled = expired = 0;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("shed", actor_shed(a, 0, on_expired) == 0);
+
+    message_t msg = {MSG_LATE, 0, NULL};
+    mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_join(a);
+    mu_assert("live handled", handled == WORKS);
+    mu_assert("stale expired", expired == WORKS);
+    mu_assert("counted", actor_system_shed() == WORKS);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *over_depth()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.termination = ACTOR_TERMINATE_QUIESCENT;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    handled = expired = 0;
+    slowed = released = false;
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+    mu_assert("shed", actor_shed(a, DEPTH, on_expired) == 0);
+
+    message_t msg = {MSG_SLOW, 0, NULL};
+    mu_assert("send slow", send_message(a, msg) == 0);
+
+    // the work piles up while the actor is busy
+    while (!slowed)
+        usleep(100);
+
+    message_t job = {MSG_WORK, 0, NULL};
+    for (int i = 0; i < WORKS; ++i)
+        mu_assert("send work", send_message(a, job) == 0);
+
+    released = true;
+    actor_system_join(a);
+    mu_assert("newest handled", handled == DEPTH);
+    mu_assert("oldest shed", expired == WORKS - DEPTH);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(past_deadline);
+    mu_run_test(over_depth);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
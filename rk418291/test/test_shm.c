@@ -0,0 +1,188 @@
+#include "minunit.h"
+#include "cacti_shm.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MSG_PING (message_type_t)1
+#define MSG_PONG (message_type_t)2
+#define MSG_START (message_type_t)3
+
+#define PINGS 1000
+
+int tests_run = 0;
+
+static char segment[64];
+static long pongs;
+static long sum;
+static _Atomic long attempts;
+static _Atomic bool detached;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+// runs in the other process and answers through the ring of the asking one
+static void ping(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    long value = *(long *)data + 1;
+    message_t pong = {MSG_PONG, nbytes, &value};
+    ctx_reply(ctx, pong);
+}
+
+static void pong(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    sum += *(long *)data;
+
+    if (++pongs == PINGS)
+    {
+        message_t godie = {MSG_GODIE, 0, NULL};
+        ctx_send(ctx, ctx->sender, godie);
+        ctx_send(ctx, ctx->self, godie);
+    }
+}
+
+static void start(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)stateptr;
+    (void)nbytes;
+    actor_id_t echo = *(actor_id_t *)data;
+
+    for (long i = 0; i < PINGS; ++i)
+    {
+        message_t msg = {MSG_PING, sizeof(long), &i};
+        ctx_send(ctx, echo, msg);
+    }
+}
+
+static act_ctx_t prompts[] = {hello, ping, pong, start};
+static role_ctx_t role = {4, prompts};
+
+static int echo_process()
+{
+    actor_id_t echo;
+
+    if (actor_shm_attach(segment, 1) != 0 || actor_system_create_ctx(&echo, &role) != 0)
+        return 1;
+
+    if (actor_shm_register("echo", echo) != 0)
+        return 1;
+
+    actor_system_join(echo);
+    return actor_shm_detach() == 0 ? 0 : 1;
+}
+
+// nobody takes from node 1's ring, so once it is full every send waits in it
+static void *flood(void *arg)
+{
+    (void)arg;
+    long value = 0;
+
+    while (!detached)
+    {
+        message_t msg = {MSG_PING, sizeof(long), &value};
+        send_message(actor_node_id(1, 0), msg);
+        ++attempts;
+    }
+
+    return NULL;
+}
+
+static char *detach_while_sending()
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/cacti_test_%d_full", (int)getpid());
+    actor_shm_unlink(name);
+
+    mu_assert("attach", actor_shm_attach(name, 0) == 0);
+
+    pthread_t sender;
+    mu_assert("sender", pthread_create(&sender, NULL, flood, NULL) == 0);
+
+    while (attempts <= ACTOR_SHM_SLOTS)
+        usleep(100);
+
+    mu_assert("detach", actor_shm_detach() == 0);
+    detached = true;
+    mu_assert("join", pthread_join(sender, NULL) == 0);
+
+    long value = 0;
+    message_t msg = {MSG_PING, sizeof(long), &value};
+    mu_assert("unrouted", send_message(actor_node_id(1, 0), msg) != 0);
+    mu_assert("unlink", actor_shm_unlink(name) == 0);
+    return 0;
+}
+
+static char *ping_pong()
+{
+    snprintf(segment, sizeof(segment), "/cacti_test_%d", (int)getpid());
+    actor_shm_unlink(segment);
+
+    pid_t child = fork();
+    mu_assert("fork", child >= 0);
+
+    if (child == 0)
+        _exit(echo_process());
+
+    mu_assert("attach", actor_shm_attach(segment, 0) == 0);
+    mu_assert("own node", actor_node_self() == 0);
+
+    actor_id_t echo;
+    while (actor_shm_lookup("echo", &echo) != 0)
+        usleep(1000);
+    mu_assert("remote id", actor_node_of(echo) == 1);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    future_t f;
+    message_t start_msg = {MSG_START, sizeof(actor_id_t), &echo};
+    mu_assert("no remote ask", ask(echo, start_msg, &f) != 0);
+    mu_assert("start", send_message(a, start_msg) == 0);
+    actor_system_join(a);
+
+    mu_assert("pongs", pongs == PINGS);
+    mu_assert("sum", sum == (long)PINGS * (PINGS + 1) / 2);
+
+    int status;
+    mu_assert("wait", waitpid(child, &status, 0) == child);
+    mu_assert("echo process", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    mu_assert("detach", actor_shm_detach() == 0);
+    mu_assert("unlink", actor_shm_unlink(segment) == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(detach_while_sending);
+    mu_run_test(ping_pong);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
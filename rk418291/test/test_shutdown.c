@@ -0,0 +1,106 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MSG_SLOW (message_type_t)1
+
+int tests_run = 0;
+
+static void hello(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+}
+
+static void slow(actor_ctx_t *ctx, void **stateptr, size_t nbytes, void *data)
+{
+    (void)ctx;
+    (void)stateptr;
+    (void)nbytes;
+    (void)data;
+    usleep(20 * 1000);
+}
+
+static act_ctx_t prompts[] = {hello, slow};
+static role_ctx_t role = {2, prompts};
+
+static long elapsed_ms(struct timespec const *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static char *drain_deadline()
+{
+    actor_config_t config;
+    actor_config_default(&config);
+    config.drain_deadline_ms = 100;
+    mu_assert("configure", actor_system_configure(&config) == 0);
+
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_SLOW, 0, NULL};
+    for (int i = 0; i < 100; ++i)
+        mu_assert("send", send_message(a, msg) == 0);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    actor_system_shutdown();
+
+    usleep(10 * 1000);
+    mu_assert("closed", send_message(a, msg) == -1);
+
+    actor_system_join(a);
+    mu_assert("deadline", elapsed_ms(&start) < 300);
+    mu_assert("dropped", actor_system_dropped() > 0);
+
+    actor_config_default(&config);
+    mu_assert("reset", actor_system_configure(&config) == 0);
+    return 0;
+}
+
+static char *drain_everything()
+{
+    actor_id_t a;
+    mu_assert("create", actor_system_create_ctx(&a, &role) == 0);
+
+    message_t msg = {MSG_SLOW, 0, NULL};
+    for (int i = 0; i < 5; ++i)
+        mu_assert("send", send_message(a, msg) == 0);
+
+    actor_system_shutdown();
+    actor_system_join(a);
+    mu_assert("nothing dropped", actor_system_dropped() == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(drain_deadline);
+    mu_run_test(drain_everything);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
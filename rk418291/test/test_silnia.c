@@ -0,0 +1,84 @@
+#include "minunit.h"
+#include "silnia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BIG_N 30000
+
+int tests_run = 0;
+
+// 30000! has 121288 digits, 7498 trailing zeros and a digit sum of 511470
+static char *big_product_splits()
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    mu_assert("stream", out != NULL);
+
+    size_t before = silnia_big_splits();
+    mu_assert("silnia", silnia_big(BIG_N, out) == 0);
+    fclose(out);
+
+    mu_assert("split into tasks", silnia_big_splits() > before);
+
+    size_t digits = strlen(text) - 1;
+    size_t zeros = 0;
+    long sum = 0;
+
+    while (zeros < digits && text[digits - 1 - zeros] == '0')
+        ++zeros;
+
+    for (size_t i = 0; i < digits; ++i)
+        sum += text[i] - '0';
+
+    mu_assert("digits", digits == 121288);
+    mu_assert("leading", strncmp(text, "27595372462193845993", 20) == 0);
+    mu_assert("zeros", zeros == 7498);
+    mu_assert("digit sum", sum == 511470);
+
+    free(text);
+    return 0;
+}
+
+static char *small_product_whole()
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    mu_assert("stream", out != NULL);
+
+    size_t before = silnia_big_splits();
+    mu_assert("silnia", silnia_big(25, out) == 0);
+    fclose(out);
+
+    mu_assert("not split", silnia_big_splits() == before);
+    mu_assert("25!", strcmp(text, "15511210043330985984000000\n") == 0);
+
+    free(text);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(small_product_whole);
+    mu_run_test(big_product_splits);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}